@@ -0,0 +1,444 @@
+/*
+*   apic.c - local APIC and I/O APIC access. Every processor has a local APIC at the same physical
+*   address, and sees only its own there. Used to start the application processors, send interrupts
+*   between processors and end interrupts with a single store. The I/O APIC takes over the ISA IRQs
+*   from the 8259s when the MP/ACPI tables describe one: masking a line is one register write and
+*   the end of interrupt goes to the local APIC, with no port I/O.
+*/
+
+#include "apic.h"
+#include "i8259.h"
+#include "paging.h"
+#include "lib.h"
+
+volatile uint32_t lapic_base = 0;
+
+/* CPUID leaf 1 ECX: the local APIC timer has the TSC-deadline mode */
+#define CPUID_TSC_DEADLINE		0x01000000
+
+uint32_t lapic_timer_deadline_mode = 0;
+/* Timer counts per time stamp counter cycle, as a 0.32 fixed point fraction (the timer is slower) */
+static uint32_t lapic_counts_per_cycle = 0;
+
+/*** Struct: ioapic_t
+*    id - its APIC id, the MP table names it in interrupt entries
+*    base - virtual address of its registers
+*    gsi_base - global system interrupt of its first pin
+*    entries - number of pins (redirection table entries)
+***/
+typedef struct ioapic {
+	uint32_t id;
+	uint32_t base;
+	uint32_t gsi_base;
+	uint32_t entries;
+} ioapic_t;
+
+static ioapic_t ioapics[MAX_IOAPICS];
+static uint32_t ioapic_count = 0;
+uint32_t ioapic_enabled = 0;
+
+/* ISA IRQs the firmware wired to another GSI (IRQ 0 to GSI 2 is usual) or polarity/trigger mode */
+static uint32_t irq_override_mask = 0;
+static uint32_t irq_gsi[ISA_IRQS];
+static uint32_t irq_flags[ISA_IRQS];
+/* Where each ISA IRQ's redirection entry is and the low half written there (without the mask bit),
+ * so masking and unmasking is a single write. irq_ioapic is NULL for lines no I/O APIC pin serves */
+static ioapic_t* irq_ioapic[ISA_IRQS];
+static uint32_t irq_redir_reg[ISA_IRQS];
+static uint32_t irq_redir_low[ISA_IRQS];
+
+/*
+*   Function: lapic_read / lapic_write
+*   Description: access one 32 bit local APIC register, they must be read and written whole
+*   inputs: reg -- register offset
+*           value -- value to write
+*/
+static inline uint32_t
+lapic_read(uint32_t reg)
+{
+	return *(volatile uint32_t*)(lapic_base + reg);
+}
+
+static inline void
+lapic_write(uint32_t reg, uint32_t value)
+{
+	*(volatile uint32_t*)(lapic_base + reg) = value;
+}
+
+/*
+*   Function: lapic_map
+*   Description: maps the local APIC registers (uncached) into the kernel's address space
+*   inputs: phys -- physical address of the registers
+*   outputs: none
+*   effects: must run before the first process is created, processes copy the kernel's mappings
+*/
+void
+lapic_map(uint32_t phys)
+{
+	lapic_base = mapMmio(phys);
+}
+
+/*
+*   Function: lapic_enable
+*   Description: software enables the calling processor's local APIC, accepting every priority
+*   inputs: none
+*   outputs: none
+*/
+void
+lapic_enable(void)
+{
+	lapic_write(LAPIC_TPR, 0);
+	lapic_write(LAPIC_SVR, LAPIC_SVR_ENABLE | SPURIOUS_VECTOR);
+	/* The error status register has to be written before it is read */
+	lapic_write(LAPIC_ESR, 0);
+	lapic_write(LAPIC_ESR, 0);
+}
+
+/*
+*   Function: lapic_id
+*   Description: reads the APIC id of the calling processor
+*   inputs: none
+*   outputs: the id
+*/
+uint32_t
+lapic_id(void)
+{
+	return lapic_read(LAPIC_ID) >> 24;
+}
+
+/*
+*   Function: lapic_eoi
+*   Description: signals the end of the interrupt being handled, a single store
+*   inputs: none
+*   outputs: none
+*/
+void
+lapic_eoi(void)
+{
+	lapic_write(LAPIC_EOI, 0);
+}
+
+/*
+*   Function: lapic_send_icr
+*   Description: writes the interrupt command register and waits until the interrupt is sent
+*   inputs: apic_id -- destination processor
+*           command -- low half of the register (delivery mode, vector, ...)
+*   outputs: none
+*/
+static void
+lapic_send_icr(uint32_t apic_id, uint32_t command)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	lapic_write(LAPIC_ICR_HIGH, apic_id << ICR_DEST_SHIFT);
+	lapic_write(LAPIC_ICR_LOW, command);
+	while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING)
+		;
+	restore_flags(flags);
+}
+
+/*
+*   Function: lapic_send_ipi
+*   Description: sends a fixed interrupt to another processor
+*   inputs: apic_id -- destination processor
+*           vector -- IDT vector it takes
+*   outputs: none
+*/
+void
+lapic_send_ipi(uint32_t apic_id, uint32_t vector)
+{
+	lapic_send_icr(apic_id, ICR_FIXED | vector);
+}
+
+/*
+*   Function: lapic_send_init / lapic_send_startup
+*   Description: the INIT and STARTUP interrupts of the universal startup algorithm. After INIT a
+*                processor waits for STARTUP, which starts it in real mode at vector_page << 12
+*   inputs: apic_id -- destination processor
+*           vector_page -- 4KB page (below 1MB) its first instruction is in
+*   outputs: none
+*/
+void
+lapic_send_init(uint32_t apic_id)
+{
+	lapic_send_icr(apic_id, ICR_INIT | ICR_LEVEL_TRIGGER | ICR_LEVEL_ASSERT);
+	lapic_send_icr(apic_id, ICR_INIT | ICR_LEVEL_TRIGGER);
+}
+
+void
+lapic_send_startup(uint32_t apic_id, uint32_t vector_page)
+{
+	lapic_send_icr(apic_id, ICR_STARTUP | (vector_page & 0xFF));
+}
+
+/*
+*   Function: lapic_timer_calibrate_start / lapic_timer_calibrate_end
+*   Description: measure the timer's rate against the time stamp counter: it counts down, masked, from
+*                the largest count while the caller waits a known time (PIT ticks). The TSC-deadline
+*                mode is used from then on if the processor has it, the ratio otherwise
+*   inputs: tsc_cycles -- time stamp counter cycles since lapic_timer_calibrate_start
+*   outputs: none
+*/
+void
+lapic_timer_calibrate_start(void)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+	lapic_write(LAPIC_LVT_TIMER, LVT_MASKED | LVT_TIMER_ONE_SHOT | LAPIC_TIMER_VECTOR);
+	lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+}
+
+void
+lapic_timer_calibrate_end(uint32_t tsc_cycles)
+{
+	uint32_t counts = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+	uint32_t eax = 1, ebx, ecx, edx;
+
+	lapic_write(LAPIC_TIMER_INITIAL, 0);
+	if (tsc_cycles == 0 || counts >= tsc_cycles)
+		lapic_counts_per_cycle = 0xFFFFFFFF;
+	else
+		lapic_counts_per_cycle = div64_32((uint64_t)counts << 32, tsc_cycles);
+
+	asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	lapic_timer_deadline_mode = (ecx & CPUID_TSC_DEADLINE) != 0;
+}
+
+/*
+*   Function: lapic_timer_setup
+*   Description: points the calling processor's timer at LAPIC_TIMER_VECTOR, in the mode chosen by
+*                calibration. It stays quiet until armed
+*   inputs: none
+*   outputs: none
+*/
+void
+lapic_timer_setup(void)
+{
+	lapic_write(LAPIC_TIMER_DIVIDE, TIMER_DIVIDE_16);
+	lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR |
+			(lapic_timer_deadline_mode ? LVT_TIMER_TSC_DEADLINE : LVT_TIMER_ONE_SHOT));
+}
+
+/*
+*   Function: lapic_timer_arm / lapic_timer_stop
+*   Description: arm the calling processor's timer to interrupt once when the time stamp counter reaches
+*                deadline (right away if it already has), or disarm it
+*   inputs: deadline -- time stamp counter value
+*   outputs: none
+*/
+void
+lapic_timer_arm(uint64_t deadline)
+{
+	uint64_t now;
+	uint32_t cycles;
+
+	if (lapic_timer_deadline_mode) {
+		wrmsr(MSR_TSC_DEADLINE, deadline);
+		return;
+	}
+	/* A deadline further out than the count reaches interrupts early, the tick code arms it again */
+	now = rdtsc();
+	if (deadline <= now)
+		cycles = 0;
+	else if (deadline - now > 0xFFFFFFFF)
+		cycles = 0xFFFFFFFF;
+	else
+		cycles = (uint32_t)(deadline - now);
+	lapic_write(LAPIC_TIMER_INITIAL, (uint32_t)(((uint64_t)cycles * lapic_counts_per_cycle) >> 32) + 1);
+}
+
+void
+lapic_timer_stop(void)
+{
+	if (lapic_timer_deadline_mode)
+		wrmsr(MSR_TSC_DEADLINE, 0);
+	else
+		lapic_write(LAPIC_TIMER_INITIAL, 0);
+}
+
+/*
+*   Function: ioapic_read / ioapic_write
+*   Description: access a register of an I/O APIC through its index and data window. Interrupts are
+*                off in between, so nothing changes the index under us
+*   inputs: io -- the I/O APIC
+*           reg -- register index
+*           value -- value to write
+*/
+static uint32_t
+ioapic_read(ioapic_t* io, uint32_t reg)
+{
+	uint32_t flags, value;
+
+	cli_and_save(flags);
+	*(volatile uint32_t*)(io->base + IOAPIC_REGSEL) = reg;
+	value = *(volatile uint32_t*)(io->base + IOAPIC_WINDOW);
+	restore_flags(flags);
+	return value;
+}
+
+static void
+ioapic_write(ioapic_t* io, uint32_t reg, uint32_t value)
+{
+	uint32_t flags;
+
+	cli_and_save(flags);
+	*(volatile uint32_t*)(io->base + IOAPIC_REGSEL) = reg;
+	*(volatile uint32_t*)(io->base + IOAPIC_WINDOW) = value;
+	restore_flags(flags);
+}
+
+/*
+*   Function: ioapic_add
+*   Description: maps an I/O APIC's registers and records which global system interrupts its pins are
+*   inputs: id -- its APIC id
+*           phys -- physical address of its registers
+*           gsi_base -- GSI of its first pin, or IOAPIC_NEXT_GSI to follow the last one added
+*   outputs: none
+*   effects: must run before the first process is created, processes copy the kernel's mappings
+*/
+void
+ioapic_add(uint32_t id, uint32_t phys, uint32_t gsi_base)
+{
+	ioapic_t* io;
+
+	if (ioapic_count == MAX_IOAPICS)
+		return;
+	io = &ioapics[ioapic_count];
+	io->id = id;
+	/* The registers are 16 byte aligned inside the 4MB page mapMmio maps */
+	io->base = mapMmio(phys);
+	if (gsi_base == IOAPIC_NEXT_GSI)
+		gsi_base = ioapic_count == 0 ? 0 : ioapics[ioapic_count - 1].gsi_base + ioapics[ioapic_count - 1].entries;
+	io->gsi_base = gsi_base;
+	io->entries = ((ioapic_read(io, IOAPIC_REG_VERSION) >> IOAPIC_MAX_ENTRY_SHIFT) & 0xFF) + 1;
+	ioapic_count++;
+}
+
+/*
+*   Function: ioapic_pin_gsi
+*   Description: gives the global system interrupt of a pin, for the MP table's interrupt entries
+*   inputs: id -- APIC id of the I/O APIC
+*           pin -- its pin
+*   outputs: the GSI, or IOAPIC_NEXT_GSI if no such I/O APIC was added
+*/
+uint32_t
+ioapic_pin_gsi(uint32_t id, uint32_t pin)
+{
+	uint32_t i;
+
+	for (i = 0; i < ioapic_count; i++)
+		if (ioapics[i].id == id)
+			return ioapics[i].gsi_base + pin;
+	return IOAPIC_NEXT_GSI;
+}
+
+/*
+*   Function: ioapic_set_override
+*   Description: records that an ISA IRQ is not wired to the GSI of the same number, or not active high
+*                and edge triggered
+*   inputs: irq -- the ISA IRQ
+*           gsi -- the global system interrupt it arrives on
+*           flags -- INTI_ polarity and trigger mode bits
+*   outputs: none
+*/
+void
+ioapic_set_override(uint32_t irq, uint32_t gsi, uint32_t flags)
+{
+	if (irq >= ISA_IRQS)
+		return;
+	irq_override_mask |= 1 << irq;
+	irq_gsi[irq] = gsi;
+	irq_flags[irq] = flags;
+}
+
+/*
+*   Function: ioapic_route
+*   Description: writes the redirection entry of an ISA IRQ, masked: its vector, polarity, trigger mode
+*                and the processor it goes to
+*   inputs: irq -- the ISA IRQ
+*           dest_apic_id -- the processor
+*   outputs: none
+*/
+static void
+ioapic_route(uint32_t irq, uint32_t dest_apic_id)
+{
+	uint32_t gsi = irq, flags = 0, low, i;
+	ioapic_t* io;
+
+	if (irq_override_mask & (1 << irq)) {
+		gsi = irq_gsi[irq];
+		flags = irq_flags[irq];
+	}
+	for (i = 0; i < ioapic_count; i++) {
+		io = &ioapics[i];
+		if (gsi < io->gsi_base || gsi >= io->gsi_base + io->entries)
+			continue;
+		low = IRQ_VECTOR_BASE + irq;
+		if ((flags & INTI_POLARITY_MASK) == INTI_ACTIVE_LOW)
+			low |= REDIR_ACTIVE_LOW;
+		if ((flags & INTI_TRIGGER_MASK) == INTI_LEVEL)
+			low |= REDIR_LEVEL_TRIGGER;
+		irq_ioapic[irq] = io;
+		irq_redir_reg[irq] = IOAPIC_REDIR_TABLE + 2 * (gsi - io->gsi_base);
+		irq_redir_low[irq] = low;
+		ioapic_write(io, irq_redir_reg[irq] + 1, dest_apic_id << REDIR_DEST_SHIFT);
+		ioapic_write(io, irq_redir_reg[irq], low | REDIR_MASKED);
+		return;
+	}
+}
+
+/*
+*   Function: ioapic_init
+*   Description: masks every I/O APIC pin, points the ISA IRQs at their usual vectors and moves the
+*                lines the 8259s had enabled over. A request the 8259s had already latched is raised
+*                again as a self IPI, an edge triggered device (the RTC) would not raise it twice
+*   inputs: dest_apic_id -- the processor that gets the ISA IRQs
+*   outputs: 0 on success, -1 if there is no I/O APIC (the 8259s stay in use)
+*/
+int32_t
+ioapic_init(uint32_t dest_apic_id)
+{
+	uint32_t flags, enabled, pending, irq, i, pin;
+
+	if (ioapic_count == 0)
+		return -1;
+	for (i = 0; i < ioapic_count; i++)
+		for (pin = 0; pin < ioapics[i].entries; pin++)
+			ioapic_write(&ioapics[i], IOAPIC_REDIR_TABLE + 2 * pin, REDIR_MASKED);
+
+	cli_and_save(flags);
+	enabled = i8259_mask_all(&pending);
+	for (irq = 0; irq < ISA_IRQS; irq++) {
+		if (irq == SLAVE_IRQ_LINE)
+			continue;
+		ioapic_route(irq, dest_apic_id);
+		if (enabled & (1 << irq))
+			ioapic_enable_irq(irq);
+	}
+	ioapic_enabled = 1;
+	for (irq = 0; irq < ISA_IRQS; irq++)
+		if (irq != SLAVE_IRQ_LINE && (enabled & pending & (1 << irq)))
+			lapic_send_ipi(dest_apic_id, IRQ_VECTOR_BASE + irq);
+	restore_flags(flags);
+	return 0;
+}
+
+/*
+*   Function: ioapic_enable_irq / ioapic_disable_irq
+*   Description: unmask / mask an ISA IRQ in its redirection entry, a single register write
+*   inputs: irq -- the ISA IRQ
+*   outputs: none
+*/
+void
+ioapic_enable_irq(uint32_t irq)
+{
+	if (irq < ISA_IRQS && irq_ioapic[irq] != NULL)
+		ioapic_write(irq_ioapic[irq], irq_redir_reg[irq], irq_redir_low[irq]);
+}
+
+void
+ioapic_disable_irq(uint32_t irq)
+{
+	if (irq < ISA_IRQS && irq_ioapic[irq] != NULL)
+		ioapic_write(irq_ioapic[irq], irq_redir_reg[irq], irq_redir_low[irq] | REDIR_MASKED);
+}
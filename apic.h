@@ -0,0 +1,133 @@
+/*
+*	apic.h - Function Header File to be used with "apic.c"
+*/
+#ifndef _APIC_H
+#define _APIC_H
+
+#include "types.h"
+
+/* Where the local APIC registers are unless the MP/ACPI tables say otherwise */
+#define LAPIC_DEFAULT_BASE		0xFEE00000
+
+/* Local APIC registers, offsets from its base */
+#define LAPIC_ID				0x020
+#define LAPIC_VERSION			0x030
+#define LAPIC_TPR				0x080
+#define LAPIC_EOI				0x0B0
+#define LAPIC_SVR				0x0F0
+#define LAPIC_ESR				0x280
+#define LAPIC_ICR_LOW			0x300
+#define LAPIC_ICR_HIGH			0x310
+#define LAPIC_LVT_TIMER			0x320
+#define LAPIC_TIMER_INITIAL		0x380
+#define LAPIC_TIMER_CURRENT		0x390
+#define LAPIC_TIMER_DIVIDE		0x3E0
+
+/* Spurious vector register: software enable */
+#define LAPIC_SVR_ENABLE		0x100
+
+/* Timer: local vector table entry fields, and the divider used (bus clock / 16) */
+#define LVT_MASKED				0x00010000
+#define LVT_TIMER_ONE_SHOT		0x00000000
+#define LVT_TIMER_TSC_DEADLINE	0x00040000
+#define TIMER_DIVIDE_16			0x3
+
+/* Deadline MSR of the TSC-deadline timer mode */
+#define MSR_TSC_DEADLINE		0x6E0
+
+/* Interrupt command register fields */
+#define ICR_FIXED				0x00000000
+#define ICR_INIT				0x00000500
+#define ICR_STARTUP				0x00000600
+#define ICR_DELIVERY_PENDING	0x00001000
+#define ICR_LEVEL_ASSERT		0x00004000
+#define ICR_LEVEL_TRIGGER		0x00008000
+#define ICR_DEST_SHIFT			24
+
+/* I/O APIC registers: an index register and a data window, the registers behind them */
+#define IOAPIC_REGSEL			0x00
+#define IOAPIC_WINDOW			0x10
+#define IOAPIC_REG_VERSION		0x01
+#define IOAPIC_REDIR_TABLE		0x10
+#define IOAPIC_MAX_ENTRY_SHIFT	16
+
+/* Redirection table entry fields (low half, the destination APIC id is in the top byte of the high half) */
+#define REDIR_ACTIVE_LOW		0x00002000
+#define REDIR_LEVEL_TRIGGER		0x00008000
+#define REDIR_MASKED			0x00010000
+#define REDIR_DEST_SHIFT		24
+
+/* Polarity and trigger mode of an interrupt source override (MADT) or I/O interrupt entry (MP table),
+ * 0 in either field means the bus default: active high, edge triggered for ISA */
+#define INTI_POLARITY_MASK		0x3
+#define INTI_ACTIVE_LOW			0x3
+#define INTI_TRIGGER_MASK		0xC
+#define INTI_LEVEL				0xC
+
+/* I/O APICs the kernel drives, ISA IRQ lines, and the vector of IRQ 0 (the same as with the 8259s) */
+#define MAX_IOAPICS				4
+#define ISA_IRQS				16
+#define IRQ_VECTOR_BASE			0x20
+
+/* The MP table gives no GSI base, its I/O APICs take their pins in order */
+#define IOAPIC_NEXT_GSI			0xFFFFFFFF
+
+/* Vectors of the interrupts the local APIC itself raises */
+#define LAPIC_TIMER_VECTOR		0xFB
+#define RESCHEDULE_VECTOR		0xFC
+#define TLB_FLUSH_VECTOR		0xFD
+#define SPURIOUS_VECTOR			0xFF
+
+/* Virtual address of the local APIC registers, 0 until lapic_map */
+extern volatile uint32_t lapic_base;
+
+/* Set when the timer is armed with a TSC deadline rather than a count */
+extern uint32_t lapic_timer_deadline_mode;
+
+/* Set once the ISA IRQs are delivered through the I/O APIC instead of the 8259s */
+extern uint32_t ioapic_enabled;
+
+/* Maps the local APIC registers at the physical address from the MP/ACPI tables */
+void lapic_map(uint32_t phys);
+
+/* Turns on the local APIC of the calling processor */
+void lapic_enable(void);
+
+/* APIC id of the calling processor */
+uint32_t lapic_id(void);
+
+/* Acknowledges the interrupt being handled */
+void lapic_eoi(void);
+
+/* Sends an interrupt to another processor's local APIC */
+void lapic_send_ipi(uint32_t apic_id, uint32_t vector);
+
+/* INIT and STARTUP IPIs, to start an application processor at vector_page << 12 */
+void lapic_send_init(uint32_t apic_id);
+void lapic_send_startup(uint32_t apic_id, uint32_t vector_page);
+
+/* Timer calibration: counts down from the largest count until lapic_timer_calibrate_end, which gets
+ * the time stamp counter cycles that went by */
+void lapic_timer_calibrate_start(void);
+void lapic_timer_calibrate_end(uint32_t tsc_cycles);
+
+/* Sets up the calling processor's timer to raise LAPIC_TIMER_VECTOR once when armed */
+void lapic_timer_setup(void);
+
+/* Arms the calling processor's timer for a time stamp counter value, or stops it */
+void lapic_timer_arm(uint64_t deadline);
+void lapic_timer_stop(void);
+
+/* I/O APICs and ISA IRQ overrides found in the MP/ACPI tables */
+void ioapic_add(uint32_t id, uint32_t phys, uint32_t gsi_base);
+uint32_t ioapic_pin_gsi(uint32_t id, uint32_t pin);
+void ioapic_set_override(uint32_t irq, uint32_t gsi, uint32_t flags);
+
+/* Moves the ISA IRQs from the 8259s to the I/O APIC, delivered to the processor dest_apic_id */
+int32_t ioapic_init(uint32_t dest_apic_id);
+
+/* Unmasks / masks an ISA IRQ in its I/O APIC redirection entry */
+void ioapic_enable_irq(uint32_t irq);
+void ioapic_disable_irq(uint32_t irq);
+
+#endif /* _APIC_H */
@@ -0,0 +1,414 @@
+/*
+*   benchmark.c - micro benchmarks for kernel fast paths, timed with rdtsc.
+*   Built with "make BENCHMARK=1", in which case entry() calls run_benchmarks()
+*   instead of launching the shells.
+*/
+
+#include "benchmark.h"
+#include "lib.h"
+#include "types.h"
+#include "fileSystemModule.h"
+#include "system_calls.h"
+#include "scheduling.h"
+#include "paging.h"
+#include "i8259.h"
+#include "apic.h"
+#include "terminal.h"
+
+#ifdef BENCHMARK
+
+/* Synthetic boot block holding the maximum number of dir entries */
+static uint8_t synthetic_boot_block[BLOCK_SIZE] __attribute__((aligned(BLOCK_SIZE)));
+
+/*
+*   Function: time_lookups
+*   Description: looks up every name in names BENCH_ITERATIONS times with the given lookup function
+*   inputs: lookup -- read_dentry_by_name or read_dentry_by_name_linear
+*           names -- the file names to look up
+*           count -- number of names
+*   outputs: returns the average number of cycles per lookup
+*/
+static uint32_t
+time_lookups(int32_t (*lookup)(const uint8_t*, dentry_t*), uint8_t names[][NAMESIZE+1], int count)
+{
+    dentry_t dentry;
+    uint64_t start;
+    uint32_t cycles;
+    int i, j;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        for (j = 0; j < count; j++)
+            lookup(names[j], &dentry);
+    cycles = (uint32_t)(rdtsc() - start);
+
+    return cycles / (BENCH_ITERATIONS * count);
+}
+
+/*
+*   Function: bench_current_image
+*   Description: times hashed and linear lookups of every name in the mounted image, plus one
+*                name that does not exist (the worst case for the linear scan)
+*   inputs: label -- name of the image printed with the results
+*   outputs: none
+*/
+static void
+bench_current_image(int8_t* label)
+{
+    static uint8_t names[MAX_DENTRIES+1][NAMESIZE+1];
+    dentry_t dentry;
+    int count = 0;
+
+    while (count < MAX_DENTRIES && read_dentry_by_index(count, &dentry) == 0) {
+        strncpy((int8_t*)names[count], dentry.fileName, NAMESIZE);
+        names[count][NAMESIZE] = '\0';
+        count++;
+    }
+    strcpy((int8_t*)names[count++], "no_such_file");
+
+    printf("%s (%d lookups): linear %d cycles, hashed %d cycles\n", label, count,
+           time_lookups(read_dentry_by_name_linear, names, count),
+           time_lookups(read_dentry_by_name, names, count));
+}
+
+/*
+*   Function: bench_dentry_lookup
+*   Description: compares read_dentry_by_name against the linear boot block scan, first on
+*                filesys_img and then on a synthetic boot block with MAX_DENTRIES (63) entries
+*   inputs: none
+*   outputs: none
+*   effects: temporarily points FILESYSLOC at the synthetic image, then rebuilds the real index
+*/
+void
+bench_dentry_lookup(void)
+{
+    unsigned int real_fs = FILESYSLOC;
+    int8_t num_buf[12];
+    int i;
+
+    bench_current_image("filesys_img");
+
+    /* Names get longer with the index so the last entries use the full NAMESIZE bytes */
+    memset(synthetic_boot_block, 0, BLOCK_SIZE);
+    *((uint32_t *)synthetic_boot_block) = MAX_DENTRIES;
+    for (i = 0; i < MAX_DENTRIES; i++) {
+        uint8_t * dentry = synthetic_boot_block + (i+1)*DENTRYSIZE;
+        int len;
+        itoa(i, num_buf, 10);
+        memset(dentry, 'f', NAMESIZE);
+        len = (i % NAMESIZE) + 1;
+        if (len <= strlen(num_buf))
+            len = strlen(num_buf);
+        memcpy(dentry + len - strlen(num_buf), num_buf, strlen(num_buf));
+        if (len < NAMESIZE)
+            dentry[len] = '\0';
+        *((uint32_t *)(dentry + NAMESIZE)) = FILE_TYPE;
+        *((uint32_t *)(dentry + NAMESIZE + sizeof(uint32_t))) = i;
+    }
+
+    FILESYSLOC = (unsigned int)synthetic_boot_block;
+    init_filesystem();
+    bench_current_image("synthetic");
+
+    FILESYSLOC = real_fs;
+    init_filesystem();
+}
+
+/* Second kernel context for the context switch benchmark: its stack, and the saved stack pointers */
+static uint32_t switch_partner_stack[1024];
+static uint32_t switch_partner_esp;
+static uint32_t switch_main_esp;
+static int switch_reload_cr3;
+
+/*
+*   Function: switch_partner
+*   Description: the partner context, it switches straight back every time it is resumed
+*   inputs: none
+*   outputs: never returns
+*/
+static void
+switch_partner(void)
+{
+    while (1) {
+        if (switch_reload_cr3)
+            loadPageDirectory((uint32_t)pageDirectory);
+        switch_to(&switch_partner_esp, switch_main_esp, NULL, 0);
+    }
+}
+
+/*
+*   Function: time_switches
+*   Description: bounces between this context and the partner BENCH_ITERATIONS times with switch_to
+*   inputs: reload_cr3 -- also reload CR3 on every switch, as a switch between processes does
+*   outputs: returns the average number of cycles per switch
+*/
+static uint32_t
+time_switches(int reload_cr3)
+{
+    uint64_t start;
+    uint32_t cycles;
+    int i;
+
+    switch_reload_cr3 = reload_cr3;
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        if (reload_cr3)
+            loadPageDirectory((uint32_t)pageDirectory);
+        switch_to(&switch_main_esp, switch_partner_esp, NULL, 0);
+    }
+    cycles = (uint32_t)(rdtsc() - start);
+
+    return cycles / (2 * BENCH_ITERATIONS);
+}
+
+/*
+*   Function: bench_context_switch
+*   Description: measures switch_to between two kernel contexts, with and without a CR3 reload.
+*                Runs with interrupts off so no tick lands in the middle
+*   inputs: none
+*   outputs: none
+*/
+void
+bench_context_switch(void)
+{
+    uint32_t* frame = &switch_partner_stack[1024];
+    uint32_t flags, eflags;
+
+    cli_and_save(flags);
+    asm volatile("pushfl; popl %0" : "=r"(eflags));
+
+    /* Switch frame that "returns" into switch_partner */
+    *--frame = (uint32_t)switch_partner;
+    *--frame = 0;       /* ebp */
+    *--frame = 0;       /* ebx */
+    *--frame = 0;       /* esi */
+    *--frame = 0;       /* edi */
+    *--frame = eflags;
+    switch_partner_esp = (uint32_t)frame;
+
+    /* Warm up the caches before timing */
+    time_switches(0);
+    printf("context switch: switch_to %d cycles, with CR3 reload %d cycles\n",
+           time_switches(0), time_switches(1));
+    restore_flags(flags);
+}
+
+/* Line used to time masking and unmasking: nothing is attached to it, and it ends up masked */
+#define BENCH_IRQ_LINE	5
+/* The RTC's line, its 8259 end of interrupt goes to both PICs */
+#define BENCH_SLAVE_IRQ	8
+
+/*
+*   Function: time_irq_ops
+*   Description: times an end of interrupt, and unmasking plus masking a line, through one controller
+*   inputs: enable, disable, eoi -- the controller's functions
+*           eoi_irq -- IRQ whose end of interrupt is sent
+*           mask_cycles -- gets the average cycles of an unmask and mask pair
+*   outputs: returns the average number of cycles per end of interrupt
+*/
+static uint32_t
+time_irq_ops(void (*enable)(uint32_t), void (*disable)(uint32_t), void (*eoi)(uint32_t), uint32_t eoi_irq,
+             uint32_t* mask_cycles)
+{
+    uint64_t start;
+    uint32_t cycles;
+    int i;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        enable(BENCH_IRQ_LINE);
+        disable(BENCH_IRQ_LINE);
+    }
+    *mask_cycles = (uint32_t)(rdtsc() - start) / BENCH_ITERATIONS;
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        eoi(eoi_irq);
+    cycles = (uint32_t)(rdtsc() - start);
+
+    return cycles / BENCH_ITERATIONS;
+}
+
+/* lapic_eoi for time_irq_ops, the local APIC does not care which IRQ it was */
+static void
+lapic_eoi_irq(uint32_t irq_num)
+{
+    lapic_eoi();
+}
+
+/*
+*   Function: bench_irq_controller
+*   Description: compares what each interrupt costs in controller accesses on the 8259s (port I/O, two
+*                end of interrupt writes for a slave line) and on the I/O APIC (one memory mapped write
+*                each). Interrupts are off and nothing is in service, so the writes change nothing
+*   inputs: none
+*   outputs: none
+*/
+void
+bench_irq_controller(void)
+{
+    uint32_t flags, master_eoi, slave_eoi, pic_mask, apic_eoi, apic_mask;
+
+    cli_and_save(flags);
+    master_eoi = time_irq_ops(i8259_enable_irq, i8259_disable_irq, i8259_send_eoi, 0, &pic_mask);
+    slave_eoi = time_irq_ops(i8259_enable_irq, i8259_disable_irq, i8259_send_eoi, BENCH_SLAVE_IRQ, &pic_mask);
+    printf("8259: eoi %d cycles (slave line %d), unmask+mask %d cycles\n", master_eoi, slave_eoi, pic_mask);
+    if (ioapic_enabled) {
+        apic_eoi = time_irq_ops(ioapic_enable_irq, ioapic_disable_irq, lapic_eoi_irq, BENCH_SLAVE_IRQ, &apic_mask);
+        printf("I/O APIC: eoi %d cycles, unmask+mask %d cycles (in use)\n", apic_eoi, apic_mask);
+    } else {
+        printf("I/O APIC: none, the 8259s are in use\n");
+    }
+    restore_flags(flags);
+}
+
+/* What was on the screen before a benchmark scrolled it away, and the position */
+static uint8_t saved_screen[2*NUM_ROWS*NUM_COLS];
+static uint32_t saved_x, saved_y;
+
+/* Saves the screen before a benchmark that writes to it */
+static void
+save_screen(void)
+{
+    saved_x = get_screen_x();
+    saved_y = get_screen_y();
+    memcpy(saved_screen, get_screen_mem(), sizeof(saved_screen));
+}
+
+/* Puts the screen saved by save_screen back */
+static void
+restore_screen(void)
+{
+    clear();
+    memcpy(get_screen_mem(), saved_screen, sizeof(saved_screen));
+    set_screen_pos(saved_x, saved_y);
+}
+
+/*
+*   Function: bench_scroll
+*   Description: times scrolling the screen a line, by printing newlines on its bottom row. Over
+*                BENCH_ITERATIONS lines this includes the copies back to the start of video memory.
+*                The screen is put back as it was afterwards
+*   inputs: none
+*   outputs: none
+*/
+void
+bench_scroll(void)
+{
+    uint32_t flags, cycles;
+    uint64_t start;
+    int i;
+
+    cli_and_save(flags);
+    save_screen();
+    set_screen_pos(ROW_START, NUM_ROWS-1);
+
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERATIONS; i++)
+        putc('\n');
+    cycles = (uint32_t)(rdtsc() - start) / BENCH_ITERATIONS;
+
+    restore_screen();
+    printf("scroll: %d cycles per line\n", cycles);
+    restore_flags(flags);
+}
+
+/*
+*   Function: bench_term_switch
+*   Description: times switching the display between two terminals and back, which only saves and
+*                restores their cursors and points the CRTC at the other terminal's video memory
+*   inputs: none
+*   outputs: none
+*/
+void
+bench_term_switch(void)
+{
+    uint32_t flags, cycles;
+    uint64_t start;
+    int i;
+
+    cli_and_save(flags);
+    start = rdtsc();
+    for (i = 0; i < BENCH_ITERATIONS; i++) {
+        switch_terminals(TERMINAL_ONE, TERMINAL_TWO);
+        switch_terminals(TERMINAL_TWO, TERMINAL_ONE);
+    }
+    cycles = (uint32_t)(rdtsc() - start) / (2 * BENCH_ITERATIONS);
+    printf("terminal switch: %d cycles\n", cycles);
+    restore_flags(flags);
+}
+
+/* Text for bench_terminal_write: full lines, like cat of a text file */
+static uint8_t write_text[BENCH_WRITE_SIZE];
+
+/*
+*   Function: time_terminal_write
+*   Description: writes write_text to a terminal BENCH_WRITES times through terminal_write
+*   inputs: term_id -- the terminal, written as if its process were running
+*   outputs: returns the cycles it took
+*/
+static uint32_t
+time_terminal_write(uint8_t term_id)
+{
+    uint8_t executing = current_term_executing;
+    uint64_t start;
+    int i;
+
+    current_term_executing = term_id;
+    start = rdtsc();
+    for (i = 0; i < BENCH_WRITES; i++)
+        terminal_write(1, write_text, BENCH_WRITE_SIZE);
+    current_term_executing = executing;
+    return (uint32_t)(rdtsc() - start);
+}
+
+/*
+*   Function: bench_terminal_write
+*   Description: measures terminal_write throughput on the displayed terminal and on one in the background,
+*                in bytes per second once the time stamp counter is calibrated (cycles per byte before)
+*   inputs: none
+*   outputs: none
+*/
+void
+bench_terminal_write(void)
+{
+    uint32_t shown, background, i;
+    uint64_t bytes = (uint64_t)BENCH_WRITES * BENCH_WRITE_SIZE;
+
+    for (i = 0; i < BENCH_WRITE_SIZE; i++)
+        write_text[i] = (i % NUM_COLS == NUM_COLS - 1) ? '\n' : 'a' + i % 26;
+
+    save_screen();
+    shown = time_terminal_write(TERMINAL_ONE);
+    restore_screen();
+    background = time_terminal_write(TERMINAL_TWO);
+
+    if (tsc_per_tick != 0)
+        printf("terminal_write: %u bytes/s displayed, %u bytes/s in the background\n",
+               div64_32(bytes * tsc_per_tick * pit_hz, shown), div64_32(bytes * tsc_per_tick * pit_hz, background));
+    else
+        printf("terminal_write: %u cycles/KB displayed, %u cycles/KB in the background\n",
+               div64_32((uint64_t)shown << 10, (uint32_t)bytes), div64_32((uint64_t)background << 10, (uint32_t)bytes));
+}
+
+/*
+*   Function: run_benchmarks
+*   Description: runs every benchmark in this file
+*   inputs: none
+*   outputs: none
+*/
+void
+run_benchmarks(void)
+{
+    /* The terminals' screens, for the terminal benchmarks */
+    init_term_screens();
+    printf("---- kernel benchmarks (cycles per operation) ----\n");
+    bench_dentry_lookup();
+    bench_context_switch();
+    bench_irq_controller();
+    bench_scroll();
+    bench_term_switch();
+    bench_terminal_write();
+}
+
+#endif /* BENCHMARK */
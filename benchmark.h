@@ -0,0 +1,38 @@
+/*
+*	benchmark.h - Function Header File to be used with "benchmark.c"
+*	Only compiled into the kernel when building with "make BENCHMARK=1"
+*/
+#ifndef _BENCHMARK_H
+#define _BENCHMARK_H
+
+#include "types.h"
+
+/* Number of times each measured operation is repeated */
+#define BENCH_ITERATIONS	100
+
+/* terminal_write throughput: bytes per write and writes timed */
+#define BENCH_WRITE_SIZE	4000
+#define BENCH_WRITES		16
+
+/* Runs every kernel benchmark and prints the results */
+void run_benchmarks(void);
+
+/* Filesystem name lookup: hashed index vs. linear boot block scan */
+void bench_dentry_lookup(void);
+
+/* Kernel stack switch (switch_to) latency between two contexts */
+void bench_context_switch(void);
+
+/* Interrupt controller cost per interrupt: 8259 port I/O vs. I/O APIC and local APIC registers */
+void bench_irq_controller(void);
+
+/* Scrolling the screen a line: moving the CRTC start address through video memory */
+void bench_scroll(void);
+
+/* Switching the displayed terminal: the CRTC start address instead of copying the screens */
+void bench_term_switch(void);
+
+/* terminal_write throughput on the displayed and a background terminal */
+void bench_terminal_write(void);
+
+#endif /* _BENCHMARK_H */
@@ -0,0 +1,142 @@
+/*
+*   elf.c - loads ELF32 executables into user memory for execute()
+*/
+
+#include "elf.h"
+#include "fileSystemModule.h"
+#include "lib.h"
+#include "types.h"
+
+/*
+*   Function: elf_read_image
+*   Description: reads the ELF header and program headers of an executable with a single read_data
+*                call and validates them in one pass. Only PT_LOAD segments are kept, and each one must
+*                fit in the 4MB user page at 128MB, with its file bytes inside the file
+*   inputs: inode -- inode number of the executable
+*   outputs: image -- filled with the entry point and the loadable segments
+*   returns: 0 on success, -1 if the file is not a program we can run
+*/
+int32_t
+elf_read_image(uint32_t inode, elf_image_t* image)
+{
+    uint8_t header[ELF_HEADER_READ_SIZE];
+    elf32_ehdr_t * ehdr = (elf32_ehdr_t *)header;
+    elf32_phdr_t * phdr;
+    int32_t bytes_read;
+    int32_t length;
+    int entry_found = 0;
+    int i;
+
+    if ((length = read_inode_length(inode)) < 0)
+        return -1;
+    bytes_read = read_data(inode, 0, header, ELF_HEADER_READ_SIZE);
+    if (bytes_read < (int32_t)sizeof(elf32_ehdr_t))
+        return -1;
+
+    /* Magic number, then a 32 bit little endian x86 executable */
+    if ((header[0] != ASCII_DEL) || (header[1] != ASCII_E) ||
+        (header[2] != ASCII_L) || (header[3] != ASCII_F))
+        return -1;
+    if (header[EI_CLASS] != ELFCLASS32 || header[EI_DATA] != ELFDATA2LSB ||
+        ehdr->e_type != ET_EXEC || ehdr->e_machine != EM_386)
+        return -1;
+
+    /* The program headers have to be inside the bytes we already read */
+    if (ehdr->e_phentsize != sizeof(elf32_phdr_t) || ehdr->e_phoff > bytes_read ||
+        ehdr->e_phnum > (bytes_read - ehdr->e_phoff) / sizeof(elf32_phdr_t))
+        return -1;
+
+    image->inode = inode;
+    image->entry = ehdr->e_entry;
+    image->num_segments = 0;
+
+    for (i = 0; i < ehdr->e_phnum; i++)
+    {
+        phdr = (elf32_phdr_t *)(header + ehdr->e_phoff) + i;
+        if (phdr->p_type != PT_LOAD)
+            continue;
+        if (image->num_segments == ELF_MAX_SEGMENTS)
+            return -1;
+        /* Segment must sit inside the user page, without wrapping around */
+        if (phdr->p_filesz > phdr->p_memsz || phdr->p_vaddr < _128MB ||
+            phdr->p_memsz > _132MB - phdr->p_vaddr)
+            return -1;
+        /* File bytes must be in the file, so demand loading never reads short */
+        if (phdr->p_offset > (uint32_t)length || phdr->p_filesz > (uint32_t)length - phdr->p_offset)
+            return -1;
+        if (phdr->p_flags & PF_X && ehdr->e_entry >= phdr->p_vaddr &&
+            ehdr->e_entry < phdr->p_vaddr + phdr->p_memsz)
+            entry_found = 1;
+
+        image->segments[image->num_segments].offset = phdr->p_offset;
+        image->segments[image->num_segments].vaddr = phdr->p_vaddr;
+        image->segments[image->num_segments].filesz = phdr->p_filesz;
+        image->segments[image->num_segments].memsz = phdr->p_memsz;
+        image->segments[image->num_segments].flags = phdr->p_flags;
+        image->num_segments++;
+    }
+
+    /* The entry point has to land in code we are going to load */
+    if (!entry_found)
+        return -1;
+    return 0;
+}
+
+/*
+*   Function: elf_load_page
+*   Description: fills one page of user memory on demand. The page is zeroed, then the file bytes of every
+*                PT_LOAD segment that overlaps it are copied in, so .bss and the stack read as zero without
+*                ever being copied from the file
+*   inputs: image -- the image of the running program, filled in by elf_read_image
+*           page -- page aligned user virtual address to fill
+*           dest -- where the page's contents go (the page itself, or a shared frame)
+*   outputs: returns 0 on success, -1 if the file bytes could not all be read
+*   effects: writes to dest
+*/
+int32_t
+elf_load_page(const elf_image_t* image, uint32_t page, uint8_t* dest)
+{
+    const elf_segment_t * seg;
+    uint32_t start, end;
+    int i;
+
+    memset(dest, 0, ELF_PAGE_SIZE);
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segments[i];
+        /* Part of the segment's file bytes that lands in this page */
+        start = (seg->vaddr > page) ? seg->vaddr : page;
+        end = (seg->vaddr + seg->filesz < page + ELF_PAGE_SIZE) ? seg->vaddr + seg->filesz : page + ELF_PAGE_SIZE;
+        if (start < end &&
+            read_data(image->inode, seg->offset + (start - seg->vaddr), dest + (start - page), end - start) != end - start)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+*   Function: elf_page_read_only
+*   Description: checks whether a page can be shared between processes running the same program,
+*                which is the case when at least one segment covers it and none of them is writable
+*   inputs: image -- the image of the running program
+*           page -- page aligned user virtual address
+*   outputs: returns 1 if the page is read-only, 0 otherwise
+*/
+int32_t
+elf_page_read_only(const elf_image_t* image, uint32_t page)
+{
+    const elf_segment_t * seg;
+    int covered = 0;
+    int i;
+
+    for (i = 0; i < image->num_segments; i++)
+    {
+        seg = &image->segments[i];
+        if (seg->vaddr >= page + ELF_PAGE_SIZE || seg->vaddr + seg->memsz <= page)
+            continue;
+        if (seg->flags & PF_W)
+            return 0;
+        covered = 1;
+    }
+    return covered;
+}
@@ -0,0 +1,94 @@
+/*
+*	elf.h - Function Header File to be used with "elf.c"
+*/
+#ifndef _ELF_H
+#define _ELF_H
+
+#include "types.h"
+
+/* Bytes read from the start of an executable: ELF header plus program headers */
+#define ELF_HEADER_READ_SIZE	512
+/* Most PT_LOAD segments a program may have */
+#define ELF_MAX_SEGMENTS		4
+/* Granularity executables are loaded at */
+#define ELF_PAGE_SIZE			4096
+
+/* e_ident fields */
+#define EI_CLASS		4
+#define EI_DATA			5
+#define ELFCLASS32		1
+#define ELFDATA2LSB		1
+
+/* e_type, e_machine */
+#define ET_EXEC			2
+#define EM_386			3
+
+/* Program header types and flags */
+#define PT_LOAD			1
+#define PF_X			0x1
+#define PF_W			0x2
+#define PF_R			0x4
+
+/*** Struct: elf32_ehdr_t - the ELF32 file header ***/
+typedef struct {
+	uint8_t  e_ident[16];
+	uint16_t e_type;
+	uint16_t e_machine;
+	uint32_t e_version;
+	uint32_t e_entry;
+	uint32_t e_phoff;
+	uint32_t e_shoff;
+	uint32_t e_flags;
+	uint16_t e_ehsize;
+	uint16_t e_phentsize;
+	uint16_t e_phnum;
+	uint16_t e_shentsize;
+	uint16_t e_shnum;
+	uint16_t e_shstrndx;
+} __attribute__((packed)) elf32_ehdr_t;
+
+/*** Struct: elf32_phdr_t - an ELF32 program header ***/
+typedef struct {
+	uint32_t p_type;
+	uint32_t p_offset;
+	uint32_t p_vaddr;
+	uint32_t p_paddr;
+	uint32_t p_filesz;
+	uint32_t p_memsz;
+	uint32_t p_flags;
+	uint32_t p_align;
+} __attribute__((packed)) elf32_phdr_t;
+
+/*** Struct: elf_segment_t
+*    offset - where the segment's bytes start in the file
+*    vaddr - user virtual address the segment is loaded at
+*    filesz - bytes copied from the file
+*    memsz - bytes the segment takes in memory, the rest past filesz is .bss
+*    flags - PF_R / PF_W / PF_X
+***/
+typedef struct {
+	uint32_t offset;
+	uint32_t vaddr;
+	uint32_t filesz;
+	uint32_t memsz;
+	uint32_t flags;
+} elf_segment_t;
+
+/*** Struct: elf_image_t - a validated executable, ready to be loaded ***/
+typedef struct {
+	uint32_t inode;
+	uint32_t entry;
+	uint32_t num_segments;
+	elf_segment_t segments[ELF_MAX_SEGMENTS];
+} elf_image_t;
+
+/* Reads and validates the headers of an executable */
+int32_t elf_read_image(uint32_t inode, elf_image_t* image);
+
+/* Fills one 4KB user page from the PT_LOAD segments that overlap it */
+int32_t elf_load_page(const elf_image_t* image, uint32_t page, uint8_t* dest);
+
+/* Returns 1 if a page is only covered by read-only segments, so it can be shared */
+int32_t elf_page_read_only(const elf_image_t* image, uint32_t page);
+
+#endif /* _ELF_H */
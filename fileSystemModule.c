@@ -3,19 +3,36 @@
 #import "lib.h"
 #import "types.h"
 
+//FNV-1a constants used to hash file names
+#define FNV_OFFSET_BASIS 2166136261u
+#define FNV_PRIME 16777619u
+
 //file scope vars
 static int directoryLoc = 0;
 
+//hash index over the boot block dir entries, built by init_filesystem
+static int8_t dentry_hash[DENTRY_HASH_SIZE];     //dentry index per slot, DENTRY_HASH_EMPTY if free
+static uint32_t dentry_hash_keys[MAX_DENTRIES];  //full hash of each dentry name
+static uint8_t dentry_name_len[MAX_DENTRIES];    //length of each dentry name
+static int dentry_index_ready = 0;
+
+//runs of adjacent data blocks for each inode, built by init_filesystem
+static fs_extent_t fs_extents[FS_MAX_EXTENTS];
+static uint16_t inode_extent_start[FS_MAX_INODES];  //first extent of each inode in fs_extents
+static uint16_t inode_extent_count[FS_MAX_INODES];  //number of extents of each inode
+static uint8_t inode_indexed[FS_MAX_INODES];        //0 if the inode has to use the slow path
+
 /*
-*   Function: read_dentry_by_name
+*   Function: read_dentry_by_name_linear
 *   Description: given a filename and a dentry struct to fill, this funciton finds the corresponding dentry in
 *                the filesystem (if it exists) and fills the given dentry with the fileName, fileType, and 
-*                inodeNumber
+*                inodeNumber. This walks every boot block entry, so it is only used before the hash index
+*                is built (and by the lookup benchmark)
 *   inputs: fname: a c string containing the name of the file we are searching for
 *   outputs: dentry: a dentry struct * that will be filled with info about the dentry specified in fname
 *   returns: 0 on success, -1 on failure
 */
-int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry)
+int32_t read_dentry_by_name_linear (const uint8_t* fname, dentry_t* dentry)
 {
     unsigned int * fileSystemStart = (unsigned int *)FILESYSLOC;
     unsigned int numDirectories = *fileSystemStart;
@@ -51,6 +68,229 @@ int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry)
 }
 
 
+/*
+*   Function: dentry_name_hash
+*   Description: hashes (FNV-1a) a file name of at most NAMESIZE characters. The name stops at the
+*                first '\0' or after NAMESIZE bytes, whichever comes first, so the names stored in the
+*                boot block (which are not terminated when they are 32 chars long) hash the same way
+*                as the strings passed to open() and execute()
+*   inputs: name: the file name to hash
+*   outputs: none
+*   returns: the 32 bit hash of name
+*/
+static uint32_t dentry_name_hash (const uint8_t* name)
+{
+    uint32_t hash = FNV_OFFSET_BASIS;
+    int i;
+    for (i = 0; i < NAMESIZE && name[i] != '\0'; i++)
+    {
+        hash ^= name[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/*
+*   Function: build_dentry_index
+*   Description: builds an open addressing hash index over the boot block dir entries so
+*                read_dentry_by_name does not have to walk every entry on each open() and execute()
+*   inputs: none
+*   outputs: none
+*   effects: fills dentry_hash, dentry_hash_keys and dentry_name_len
+*/
+static void build_dentry_index(void)
+{
+    unsigned int numDirectories = *((unsigned int *)FILESYSLOC);
+    uint32_t slot;
+    int i;
+
+    dentry_index_ready = 0;
+    for (i = 0; i < DENTRY_HASH_SIZE; i++)
+        dentry_hash[i] = DENTRY_HASH_EMPTY;
+
+    //a corrupt boot block can not hold more entries than fit in one block
+    if (numDirectories > MAX_DENTRIES)
+        return;
+
+    for (i = 0; i < numDirectories; i++)
+    {
+        uint8_t * name = (uint8_t *)(FILESYSLOC + (i+1)*DENTRYSIZE);
+        int len = 0;
+        while (len < NAMESIZE && name[len] != '\0')
+            len++;
+        dentry_name_len[i] = len;
+        dentry_hash_keys[i] = dentry_name_hash(name);
+
+        //linear probe to the first free slot
+        slot = dentry_hash_keys[i] & (DENTRY_HASH_SIZE - 1);
+        while (dentry_hash[slot] != DENTRY_HASH_EMPTY)
+            slot = (slot + 1) & (DENTRY_HASH_SIZE - 1);
+        dentry_hash[slot] = i;
+    }
+    dentry_index_ready = 1;
+}
+
+/*
+*   Function: build_extents
+*   Description: turns the data block list of every inode into runs of adjacent data blocks (extents)
+*                so read_data can copy each run with a single memcpy. Block numbers are checked against
+*                the data block count here, once, instead of on every read. An inode only gets extents up
+*                to its first bad block, so reads past that point still fail like before
+*   inputs: none
+*   outputs: none
+*   effects: fills fs_extents, inode_extent_start, inode_extent_count and inode_indexed
+*/
+static void build_extents(void)
+{
+    uint8_t * boot_block_ptr = (uint8_t *)FILESYSLOC;
+    uint32_t total_inodes = *((uint32_t *)(boot_block_ptr + INODE_BYTE_OFFSET));
+    uint32_t total_data_blocks = *((uint32_t *)(boot_block_ptr + DATA_BLOCK_BYTE_OFFSET));
+    uint32_t inode, block, num_blocks;
+    uint32_t * block_list;
+    fs_extent_t * extent;
+    int next_extent = 0;
+
+    for (inode = 0; inode < FS_MAX_INODES; inode++)
+        inode_indexed[inode] = 0;
+
+    for (inode = 0; inode < total_inodes && inode < FS_MAX_INODES; inode++)
+    {
+        uint8_t * inode_ptr = boot_block_ptr + BLOCK_SIZE*(inode + 1);
+        uint32_t file_size = *((uint32_t *)(inode_ptr));
+
+        num_blocks = (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+        //the block list has to fit in the rest of the inode block
+        if (num_blocks > BLOCK_SIZE/INODE_BYTE_OFFSET - 1)
+            num_blocks = BLOCK_SIZE/INODE_BYTE_OFFSET - 1;
+        block_list = (uint32_t *)(inode_ptr + INODE_BYTE_OFFSET);
+
+        inode_extent_start[inode] = next_extent;
+        inode_extent_count[inode] = 0;
+        extent = NULL;
+        for (block = 0; block < num_blocks; block++)
+        {
+            if (block_list[block] >= total_data_blocks)
+                break;
+            if (extent != NULL && block_list[block] == extent->data_block + extent->count)
+            {
+                extent->count++;
+                continue;
+            }
+            //out of room: leave this inode to the slow path
+            if (next_extent == FS_MAX_EXTENTS)
+                return;
+            extent = &fs_extents[next_extent++];
+            extent->file_block = block;
+            extent->data_block = block_list[block];
+            extent->count = 1;
+            inode_extent_count[inode]++;
+        }
+        inode_indexed[inode] = 1;
+    }
+}
+
+/*
+*   Function: init_filesystem
+*   Description: called once from entry() after the filesystem module has been found. Builds the
+*                dir entry hash index and the per inode extent lists
+*   inputs: none
+*   outputs: none
+*/
+void init_filesystem(void)
+{
+    build_dentry_index();
+    build_extents();
+}
+
+/*
+*   Function: find_extent
+*   Description: finds the run of adjacent data blocks that holds a block of a file. Indexed inodes are
+*                binary searched in fs_extents, others have their block list scanned from that block on
+*   inputs: inode -- the inode number
+*           file_block -- block of the file (offset / BLOCK_SIZE)
+*           num_blocks -- number of blocks in the file
+*   outputs: extent -- filled with the run that holds file_block
+*   returns: 0 on success, -1 if the block is missing or its data block number is invalid
+*/
+static int32_t find_extent(uint32_t inode, uint32_t file_block, uint32_t num_blocks, fs_extent_t * extent)
+{
+    uint8_t * boot_block_ptr = (uint8_t *)FILESYSLOC;
+    uint32_t total_data_blocks, block;
+    uint32_t * block_list;
+
+    if (inode < FS_MAX_INODES && inode_indexed[inode])
+    {
+        int lo = inode_extent_start[inode];
+        int hi = lo + inode_extent_count[inode] - 1;
+        while (lo <= hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (file_block < fs_extents[mid].file_block)
+                hi = mid - 1;
+            else if (file_block >= fs_extents[mid].file_block + fs_extents[mid].count)
+                lo = mid + 1;
+            else
+            {
+                *extent = fs_extents[mid];
+                return 0;
+            }
+        }
+        return -1;
+    }
+
+    total_data_blocks = *((uint32_t *)(boot_block_ptr + DATA_BLOCK_BYTE_OFFSET));
+    block_list = (uint32_t *)(boot_block_ptr + BLOCK_SIZE*(inode + 1) + INODE_BYTE_OFFSET);
+    if (block_list[file_block] >= total_data_blocks)
+        return -1;
+    extent->file_block = file_block;
+    extent->data_block = block_list[file_block];
+    extent->count = 1;
+    for (block = file_block + 1; block < num_blocks; block++)
+    {
+        if (block_list[block] != extent->data_block + extent->count || block_list[block] >= total_data_blocks)
+            break;
+        extent->count++;
+    }
+    return 0;
+}
+
+/*
+*   Function: read_dentry_by_name
+*   Description: given a filename and a dentry struct to fill, this funciton finds the corresponding dentry in
+*                the filesystem (if it exists) and fills the given dentry with the fileName, fileType, and 
+*                inodeNumber. The entry is found through the hash index built by init_filesystem
+*   inputs: fname: a c string containing the name of the file we are searching for
+*   outputs: dentry: a dentry struct * that will be filled with info about the dentry specified in fname
+*   returns: 0 on success, -1 on failure
+*/
+int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry)
+{
+    uint32_t hash;
+    uint32_t slot;
+    int length;
+    int8_t index;
+
+    if (!dentry_index_ready)
+        return read_dentry_by_name_linear(fname, dentry);
+
+    //check for valid input
+    length = strlen((int8_t*)fname);
+    if (length > NAMESIZE) {
+        return -1;
+    }
+
+    hash = dentry_name_hash(fname);
+    for (slot = hash & (DENTRY_HASH_SIZE - 1); (index = dentry_hash[slot]) != DENTRY_HASH_EMPTY;
+         slot = (slot + 1) & (DENTRY_HASH_SIZE - 1))
+    {
+        //only compare names when the full hash and the length both match
+        if (dentry_hash_keys[(int)index] == hash && dentry_name_len[(int)index] == length &&
+            strncmp((int8_t*)fname, (int8_t*)(FILESYSLOC + (index+1)*DENTRYSIZE), length) == 0)
+            return read_dentry_by_index(index, dentry);
+    }
+    return -1;
+}
+
 /*
  *   Function: read_dentry_by_index
  *   Description: given an index into the bootblock dir entires, and a dentry struct to fill, 
@@ -79,6 +319,22 @@ int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry)
     return 0;
 }
 
+/*
+*   Function: read_inode_length()
+*   Description: Helper function that gets the size of a file
+*   inputs: inode -- the inode number of the file
+*   outputs: Returns the file size in bytes, or -1 on failure
+*/
+int32_t read_inode_length (uint32_t inode)
+{
+    uint8_t * boot_block_ptr = (uint8_t *)FILESYSLOC;
+    uint32_t total_inodes = *((uint32_t *)(boot_block_ptr + INODE_BYTE_OFFSET)); //get the total number of inodes
+
+    if (inode >= total_inodes) // return -1 if inode number is invalid
+        return -1;
+    return *((uint32_t *)(boot_block_ptr + BLOCK_SIZE*(inode + 1))); //file size is the first field of the inode
+}
+
 /*
 *   Function: read_data()
 *   Description: Helper function that reads bytes in the file starting from a given 
@@ -99,65 +355,38 @@ int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t lengt
     if (inode < 0 || inode >= total_inodes) // return -1 if inode number is invalid
         return -1;
 
-    uint32_t total_data_blocks = *((uint32_t *)(boot_block_ptr + DATA_BLOCK_BYTE_OFFSET)); //get the total number of data blocks
     uint8_t * inode_ptr = boot_block_ptr + BLOCK_SIZE*(inode + 1); //set a pointer to the relevant inode
     uint8_t * data_block_start_ptr = boot_block_ptr + BLOCK_SIZE*(total_inodes + 1); //set a pointer to the start of the data blocks
     uint32_t file_size = *((uint32_t *)(inode_ptr)); //get the file size in bytes
+    uint32_t num_blocks = (file_size + BLOCK_SIZE - 1) / BLOCK_SIZE;
 
     if (offset >= file_size)//return 0 if offset is at or past the end of file
         return 0;
     
     if (length + offset > file_size)// if more bytes are requested than available, cut the number of bytes requested
         length = file_size - offset;
-	
 
-    //set a pointer to the first relevant data block index in inode
-    uint32_t * data_block_index_ptr_in_inode = (uint32_t *)(inode_ptr + (offset/BLOCK_SIZE + 1)*INODE_BYTE_OFFSET);
-    if (*data_block_index_ptr_in_inode < 0 || *data_block_index_ptr_in_inode >= total_data_blocks) //return -1 if data block number is invalid
-        return -1;
-    
-    //handle the first data block
-    uint8_t * data_ptr = data_block_start_ptr + BLOCK_SIZE*(*data_block_index_ptr_in_inode) + offset%BLOCK_SIZE;//set pointer to start of data to copy
-    if (offset%BLOCK_SIZE + length <= BLOCK_SIZE )
+    //copy one run of adjacent data blocks per memcpy
+    while (byte_count < length)
     {
-        memcpy(buf, data_ptr, length);//copy length bytes into buf
-        byte_count += length;
-        return byte_count;
-    }
-    else
-    {
-        //copy (BLOCK_SIZE - offset) bytes into buf and change length and buf accordingly
-        memcpy(buf, data_ptr, BLOCK_SIZE - (offset%BLOCK_SIZE));
-        length -= BLOCK_SIZE - (offset%BLOCK_SIZE);
-        buf += BLOCK_SIZE - (offset%BLOCK_SIZE);
-        byte_count += BLOCK_SIZE - (offset%BLOCK_SIZE);
-    }
+        fs_extent_t extent;
+        uint32_t file_block = (offset + byte_count) / BLOCK_SIZE;
+        uint32_t block_offset = (offset + byte_count) % BLOCK_SIZE;
+        uint32_t chunk;
 
-    //process the rest of the data blocks
-    while (length > 0)
-    {
-        data_block_index_ptr_in_inode++; //increment data_block_index ptr
-        if (*data_block_index_ptr_in_inode < 0 || *data_block_index_ptr_in_inode >= total_data_blocks) //return -1 if data block number is invalid
-        {
+        if (find_extent(inode, file_block, num_blocks, &extent) == -1) //return -1 if data block number is invalid
             return -1;
-        }
-        data_ptr = data_block_start_ptr + BLOCK_SIZE*(*(data_block_index_ptr_in_inode));
-        if (length <= BLOCK_SIZE)
-        {
-            memcpy(buf, data_ptr, length);//copy length bytes into buf
-            byte_count += length;
-            return byte_count;
-        }
-        else
-        {
-            //copy BLOCK_SIZE bytes into buf and change length and buf accordingly
-            memcpy(buf, data_ptr, BLOCK_SIZE);
-            length -= BLOCK_SIZE;
-            buf += BLOCK_SIZE;
-            byte_count += BLOCK_SIZE;
-        }
+
+        chunk = (extent.file_block + extent.count - file_block)*BLOCK_SIZE - block_offset;
+        if (chunk > length - byte_count)
+            chunk = length - byte_count;
+
+        memcpy(buf + byte_count,
+               data_block_start_ptr + BLOCK_SIZE*(extent.data_block + file_block - extent.file_block) + block_offset,
+               chunk);
+        byte_count += chunk;
     }
-    return 0;
+    return byte_count;
 }
 
 /*
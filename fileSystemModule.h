@@ -1,3 +1,6 @@
+#ifndef _FILESYSTEMMODULE_H
+#define _FILESYSTEMMODULE_H
+
 #include "types.h"
 
 //constants
@@ -8,14 +11,33 @@
 #define INODE_BYTE_OFFSET 4
 #define DATA_BLOCK_BYTE_OFFSET 8
 
+#define MAX_DENTRIES (BLOCK_SIZE/DENTRYSIZE - 1) // dir entries that fit in the boot block
+#define DENTRY_HASH_SIZE 128 // slots in the dentry hash index (power of 2, > 2*MAX_DENTRIES)
+#define DENTRY_HASH_EMPTY -1
+
+#define FS_MAX_INODES 64    // inodes whose block lists are turned into extents at mount
+#define FS_MAX_EXTENTS 1024 // total extents kept for those inodes
+
+//a run of adjacent data blocks in a file
+typedef struct {
+    uint32_t file_block; // first block of the file in this run
+    uint32_t data_block; // data block number that file_block lives in
+    uint32_t count;      // number of adjacent blocks
+} fs_extent_t;
+
 
 //global vars
 unsigned int FILESYSLOC;
 
+//mount time setup
+void init_filesystem(void);
+
 //helper fuctions
+int32_t read_dentry_by_name_linear (const uint8_t* fname, dentry_t* dentry);
 int32_t read_dentry_by_name (const uint8_t* fname, dentry_t* dentry);
 int32_t read_dentry_by_index (uint32_t index, dentry_t* dentry);
 int32_t read_data (uint32_t inode, uint32_t offset, uint8_t* buf, uint32_t length);
+int32_t read_inode_length (uint32_t inode);
 
 //main functions
 int32_t file_open (const uint8_t* filename);
@@ -26,3 +48,5 @@ int32_t dir_open (const uint8_t* filename);
 int32_t dir_read (int32_t fd, void* buf, int32_t nbytes);
 int32_t dir_write (int32_t fd, const void* buf, int32_t nbytes);
 int32_t dir_close (int32_t fd);
+
+#endif /* _FILESYSTEMMODULE_H */
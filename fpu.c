@@ -0,0 +1,178 @@
+/*
+*   fpu.c - lazy x87/SSE context switching. Every task switch sets CR0.TS, so the
+*   first FPU or SSE instruction a task runs afterwards traps to #NM. Only then are
+*   the registers saved to the pcb of the task that last used them (the processor's
+*   fpu_owner) and the task's own registers loaded. Tasks that never touch the FPU
+*   never pay for it. With more than one processor online a task may resume on
+*   another processor, so its registers are saved as it is switched out instead.
+*/
+
+#include "fpu.h"
+#include "system_calls.h"
+#include "scheduling.h"
+#include "smp.h"
+#include "lib.h"
+
+/* CR0 and CR4 bits */
+#define CR0_MP				0x00000002	/* WAIT/FWAIT trap on TS too */
+#define CR0_EM				0x00000004	/* no FPU, every FPU instruction traps */
+#define CR0_TS				0x00000008	/* task switched */
+#define CR0_NE				0x00000020	/* x87 errors raise #MF instead of IRQ13 */
+#define CR4_OSFXSR			0x00000200	/* FXSAVE/FXRSTOR and SSE instructions */
+#define CR4_OSXMMEXCPT		0x00000400	/* unmasked SIMD exceptions raise #XF */
+
+/* CPUID leaf 1 EDX feature bits */
+#define CPUID_FXSR			0x01000000
+#define CPUID_SSE			0x02000000
+
+static int fpu_has_fxsr = 0;
+static int fpu_has_sse = 0;
+
+/* #NM traps, and how many of them had to save another task's registers / load the task's own */
+static uint32_t fpu_traps = 0;
+static uint32_t fpu_saves = 0;
+static uint32_t fpu_restores = 0;
+
+/* Makes the next FPU instruction trap to #NM */
+static inline void
+set_ts(void)
+{
+	uint32_t cr;
+	asm volatile("movl %%cr0, %0" : "=r"(cr));
+	if (!(cr & CR0_TS))
+		asm volatile("movl %0, %%cr0" : : "r"(cr | CR0_TS));
+}
+
+/* Saves the FPU registers into a task's pcb, TS must be clear */
+static inline void
+save_fpu(pcb_t * task)
+{
+	if (fpu_has_fxsr)
+		asm volatile("fxsave %0" : "=m"(task->fpu_state));
+	else
+		asm volatile("fnsave %0" : "=m"(task->fpu_state));
+	fpu_saves++;
+}
+
+/*
+*   Function: init_fpu
+*   Description: enables the FPU, and FXSAVE plus SSE when CPUID reports them, then sets TS so the
+*                first task to use it traps
+*   inputs: none
+*   outputs: none
+*/
+void
+init_fpu(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx, cr;
+
+	asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	fpu_has_fxsr = (edx & CPUID_FXSR) != 0;
+	fpu_has_sse = fpu_has_fxsr && (edx & CPUID_SSE) != 0;
+
+	if (fpu_has_fxsr) {
+		asm volatile("movl %%cr4, %0" : "=r"(cr));
+		cr |= CR4_OSFXSR;
+		if (fpu_has_sse)
+			cr |= CR4_OSXMMEXCPT;
+		asm volatile("movl %0, %%cr4" : : "r"(cr));
+	}
+
+	asm volatile("movl %%cr0, %0" : "=r"(cr));
+	cr = (cr & ~(CR0_EM | CR0_TS)) | CR0_MP | CR0_NE;
+	asm volatile("movl %0, %%cr0" : : "r"(cr));
+	asm volatile("fninit");
+
+	set_ts();
+}
+
+/*
+*   Function: fpu_task_switch
+*   Description: sets CR0.TS, the next FPU instruction traps to #NM. With more than one processor
+*                online the task being switched out gives up the FPU right away, its registers could
+*                otherwise be stuck on this processor while it runs on another
+*   inputs: prev -- the task being switched out
+*   outputs: none
+*/
+void
+fpu_task_switch(pcb_t * prev)
+{
+	cpu_t * cpu = this_cpu();
+	if (cpus_online > 1 && prev != NULL && cpu->fpu_owner == prev) {
+		asm volatile("clts");
+		save_fpu(prev);
+		cpu->fpu_owner = NULL;
+	}
+	set_ts();
+}
+
+/*
+*   Function: fpu_task_exit
+*   Description: called when a task exits, so its registers are never saved into its freed pcb
+*   inputs: task -- the exiting task
+*   outputs: none
+*/
+void
+fpu_task_exit(pcb_t * task)
+{
+	uint32_t i;
+	for (i = 0; i < cpu_count; i++)
+		if (cpus[i].fpu_owner == task)
+			cpus[i].fpu_owner = NULL;
+}
+
+/*
+*   Function: fpu_device_not_available
+*   Description: gives the FPU to the current task: clears TS, saves the owner's registers into its pcb
+*                and loads the current task's, or a clean state the first time it uses the FPU
+*   inputs: none
+*   outputs: none
+*/
+void
+fpu_device_not_available(void)
+{
+	uint32_t flags;
+	cpu_t * cpu = this_cpu();
+	pcb_t * task = cpu->current;
+
+	/* #NM comes through a trap gate, keep the tick from switching tasks half way */
+	cli_and_save(flags);
+	asm volatile("clts");
+	fpu_traps++;
+	if (cpu->fpu_owner == task) {
+		restore_flags(flags);
+		return;
+	}
+
+	if (cpu->fpu_owner != NULL)
+		save_fpu(cpu->fpu_owner);
+
+	if (task->fpu_used) {
+		if (fpu_has_fxsr)
+			asm volatile("fxrstor %0" : : "m"(task->fpu_state));
+		else
+			asm volatile("frstor %0" : : "m"(task->fpu_state));
+		fpu_restores++;
+	} else {
+		uint32_t mxcsr = MXCSR_DEFAULT;
+		asm volatile("fninit");
+		if (fpu_has_sse)
+			asm volatile("ldmxcsr %0" : : "m"(mxcsr));
+		task->fpu_used = 1;
+	}
+	cpu->fpu_owner = task;
+	restore_flags(flags);
+}
+
+/*
+*   Function: print_fpu_stats
+*   Description: prints the #NM traps and how many of them saved or loaded registers
+*   inputs: none
+*   outputs: none
+*/
+void
+print_fpu_stats(void)
+{
+	printf("FPU (%s): %u traps, %u saves, %u restores\n", fpu_has_sse ? "sse" : fpu_has_fxsr ? "fxsr" : "x87",
+			fpu_traps, fpu_saves, fpu_restores);
+}
@@ -0,0 +1,39 @@
+/*
+*	fpu.h - Function Header File to be used with "fpu.c"
+*/
+#ifndef _FPU_H
+#define _FPU_H
+
+#include "types.h"
+
+/* FXSAVE area, FNSAVE needs only the first 108 bytes */
+#define FPU_STATE_SIZE		512
+
+/* MXCSR after reset: every SIMD exception masked, round to nearest */
+#define MXCSR_DEFAULT		0x1F80
+
+struct pcb;
+
+/*** Struct: fpu_state_t - x87/MMX/SSE registers of a task while another task owns the FPU
+*    data - FXSAVE (or FNSAVE) image, FXSAVE needs it 16 byte aligned
+***/
+typedef struct fpu_state {
+	uint8_t data[FPU_STATE_SIZE];
+} __attribute__((aligned(16))) fpu_state_t;
+
+/* Turns on the FPU (and SSE if the CPU has it) and makes the first use trap */
+void init_fpu(void);
+
+/* Makes the next FPU instruction trap to #NM, called whenever current_task changes */
+void fpu_task_switch(struct pcb * prev);
+
+/* Forgets the registers of a task that is exiting */
+void fpu_task_exit(struct pcb * task);
+
+/* #NM handler, called from device_not_available_handler (interrupts.S) */
+void fpu_device_not_available(void);
+
+/* Prints the lazy switching counters */
+void print_fpu_stats(void);
+
+#endif /* _FPU_H */
@@ -0,0 +1,181 @@
+/*
+*   frames.c - physical frame allocator. A bitmap with one bit per 4KB frame, seeded from the
+*   multiboot memory map in entry(). Frames start out in use; add_free_frames() releases the
+*   ranges the boot loader reports as available and reserve_frames() takes back the ones the
+*   kernel already uses.
+*/
+
+#include "frames.h"
+#include "lib.h"
+#include "types.h"
+
+#define BITS_PER_WORD	32
+
+/* 1 = frame in use (or not RAM), 0 = free */
+static uint32_t frame_bitmap[MAX_FRAMES / BITS_PER_WORD] = {
+	[0 ... MAX_FRAMES / BITS_PER_WORD - 1] = 0xFFFFFFFF
+};
+static uint32_t frames_free = 0;
+static uint32_t memory_top = 0;
+/* Where the next single frame search starts */
+static uint32_t next_frame = 0;
+
+#define FRAME_USED(n)	(frame_bitmap[(n) / BITS_PER_WORD] & (1U << ((n) % BITS_PER_WORD)))
+
+/*
+*   Function: set_frame / clear_frame
+*   Description: mark frame number n used / free, keeping frames_free up to date
+*/
+static void
+set_frame(uint32_t n)
+{
+	if (!FRAME_USED(n)) {
+		frame_bitmap[n / BITS_PER_WORD] |= 1U << (n % BITS_PER_WORD);
+		frames_free--;
+	}
+}
+
+static void
+clear_frame(uint32_t n)
+{
+	if (FRAME_USED(n)) {
+		frame_bitmap[n / BITS_PER_WORD] &= ~(1U << (n % BITS_PER_WORD));
+		frames_free++;
+	}
+}
+
+/*
+*   Function: add_free_frames
+*   Description: marks the whole frames inside a physical range as free. Called for each
+*                available region of the multiboot memory map
+*   inputs: start, end -- physical range [start, end)
+*   outputs: none
+*/
+void
+add_free_frames(uint32_t start, uint32_t end)
+{
+	uint32_t n;
+
+	if (end > MAX_PHYS_MEM || end < start)
+		end = MAX_PHYS_MEM;
+	start = (start + FRAME_SIZE - 1) >> FRAME_SHIFT;
+	end = end >> FRAME_SHIFT;
+	for (n = start; n < end; n++)
+		clear_frame(n);
+	if (end << FRAME_SHIFT > memory_top)
+		memory_top = end << FRAME_SHIFT;
+}
+
+/*
+*   Function: reserve_frames
+*   Description: marks every frame touching a physical range as used
+*   inputs: start, end -- physical range [start, end)
+*   outputs: none
+*/
+void
+reserve_frames(uint32_t start, uint32_t end)
+{
+	uint32_t n;
+
+	if (end > MAX_PHYS_MEM || end < start)
+		end = MAX_PHYS_MEM;
+	start = start >> FRAME_SHIFT;
+	end = (end + FRAME_SIZE - 1) >> FRAME_SHIFT;
+	for (n = start; n < end; n++)
+		set_frame(n);
+}
+
+/*
+*   Function: alloc_frame
+*   Description: allocates one frame, skipping whole bitmap words that are full
+*   inputs: none
+*   outputs: physical address of the frame, or 0 if memory is exhausted
+*/
+uint32_t
+alloc_frame(void)
+{
+	uint32_t word, bit, i;
+
+	for (i = 0; i < MAX_FRAMES / BITS_PER_WORD; i++) {
+		word = (next_frame / BITS_PER_WORD + i) % (MAX_FRAMES / BITS_PER_WORD);
+		if (frame_bitmap[word] == 0xFFFFFFFF)
+			continue;
+		for (bit = 0; bit < BITS_PER_WORD; bit++) {
+			if (!(frame_bitmap[word] & (1U << bit))) {
+				set_frame(word * BITS_PER_WORD + bit);
+				next_frame = word * BITS_PER_WORD + bit + 1;
+				return (word * BITS_PER_WORD + bit) << FRAME_SHIFT;
+			}
+		}
+	}
+	return 0;
+}
+
+/*
+*   Function: alloc_frames
+*   Description: allocates count contiguous frames aligned to count frames (kernel stacks need
+*                8KB aligned pairs so the PCB can be found by masking ESP)
+*   inputs: count -- number of frames, a power of two
+*   outputs: physical address of the first frame, or 0 if no such run is free
+*/
+uint32_t
+alloc_frames(uint32_t count)
+{
+	uint32_t n, i;
+
+	for (n = 0; n + count <= MAX_FRAMES; n += count) {
+		for (i = 0; i < count; i++)
+			if (FRAME_USED(n + i))
+				break;
+		if (i == count) {
+			for (i = 0; i < count; i++)
+				set_frame(n + i);
+			return n << FRAME_SHIFT;
+		}
+	}
+	return 0;
+}
+
+/*
+*   Function: free_frame / free_frames
+*   Description: give frames back to the allocator
+*   inputs: frame -- physical address returned by alloc_frame / alloc_frames
+*           count -- number of frames allocated
+*   outputs: none
+*/
+void
+free_frame(uint32_t frame)
+{
+	free_frames(frame, 1);
+}
+
+void
+free_frames(uint32_t frame, uint32_t count)
+{
+	uint32_t i;
+
+	for (i = 0; i < count; i++)
+		clear_frame((frame >> FRAME_SHIFT) + i);
+	if ((frame >> FRAME_SHIFT) < next_frame)
+		next_frame = frame >> FRAME_SHIFT;
+}
+
+/*
+*   Function: free_frame_count
+*   Description: number of frames that can still be allocated
+*/
+uint32_t
+free_frame_count(void)
+{
+	return frames_free;
+}
+
+/*
+*   Function: phys_mem_top
+*   Description: end of the highest usable physical memory, used to size the direct map
+*/
+uint32_t
+phys_mem_top(void)
+{
+	return memory_top;
+}
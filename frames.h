@@ -0,0 +1,43 @@
+/*
+*	frames.h - Function Header File to be used with "frames.c"
+*/
+#ifndef _FRAMES_H
+#define _FRAMES_H
+
+#include "types.h"
+
+#define FRAME_SIZE			0x1000
+#define FRAME_SHIFT			12
+
+/* Physical memory above this is not managed (it is also the size of the kernel's direct map) */
+#define MAX_PHYS_MEM		0x20000000
+#define MAX_FRAMES			(MAX_PHYS_MEM / FRAME_SIZE)
+
+/* Every managed frame is mapped for the kernel at DIRECT_MAP_BASE + its physical address */
+#define DIRECT_MAP_BASE		0xC0000000
+#define PHYS_TO_VIRT(addr)	((uint32_t)(addr) + DIRECT_MAP_BASE)
+#define VIRT_TO_PHYS(addr)	((uint32_t)(addr) - DIRECT_MAP_BASE)
+
+/* Marks a physical range usable (from the multiboot memory map) */
+void add_free_frames(uint32_t start, uint32_t end);
+
+/* Marks a physical range in use (kernel, modules, ...) */
+void reserve_frames(uint32_t start, uint32_t end);
+
+/* Allocates one frame, returns its physical address or 0 */
+uint32_t alloc_frame(void);
+
+/* Allocates count (a power of two) contiguous frames aligned to count frames */
+uint32_t alloc_frames(uint32_t count);
+
+/* Frees frames returned by alloc_frame / alloc_frames */
+void free_frame(uint32_t frame);
+void free_frames(uint32_t frame, uint32_t count);
+
+/* Number of free frames left */
+uint32_t free_frame_count(void);
+
+/* End of the highest usable physical memory */
+uint32_t phys_mem_top(void);
+
+#endif /* _FRAMES_H */
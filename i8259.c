@@ -1,8 +1,11 @@
 /* i8259.c - Functions to interact with the 8259 interrupt controller
  * vim:ts=4 noexpandtab
+ * enable_irq, disable_irq and send_eoi go to the I/O APIC instead once it
+ * has taken the ISA IRQs over (apic.c); the 8259s are the fallback.
  */
 
 #include "i8259.h"
+#include "apic.h"
 #include "lib.h"
 
 /* Ports that each PIC sits on */
@@ -48,10 +51,66 @@ i8259_init(void)
 	outb(ICW4, SLAVE_8259_PORT2);
 
 	//Enabling the Slave IRQ Line (being on line #2)
-	enable_irq(SLAVE_IRQ_LINE);
+	i8259_enable_irq(SLAVE_IRQ_LINE);
 }
 
-/*	Function: enable_irq(uint32_t irq_num)
+/*	Function: enable_irq / disable_irq / send_eoi
+*	Description: Enable (unmask) / disable (mask) the specified IRQ, and signal its end of
+*				 interrupt, on whichever controller delivers the ISA IRQs
+*	input: irq_num -- the number of the IRQ line to operate on
+*	output: none
+*/
+void
+enable_irq(uint32_t irq_num)
+{
+	if (ioapic_enabled)
+		ioapic_enable_irq(irq_num);
+	else
+		i8259_enable_irq(irq_num);
+}
+
+void
+disable_irq(uint32_t irq_num)
+{
+	if (ioapic_enabled)
+		ioapic_disable_irq(irq_num);
+	else
+		i8259_disable_irq(irq_num);
+}
+
+void
+send_eoi(uint32_t irq_num)
+{
+	if (ioapic_enabled)
+		lapic_eoi();
+	else
+		i8259_send_eoi(irq_num);
+}
+
+/*	Function: i8259_mask_all(uint32_t* pending)
+*	Description: Masks every line of both PICs, when the I/O APIC takes the IRQs over
+*	input: pending -- gets the lines whose request is latched in the PICs (IRR)
+*	output: the lines that were enabled, IRQ n in bit n
+*	effects: the slave line stays unmasked, so nothing else needs to change to unmask them again
+*/
+uint32_t
+i8259_mask_all(uint32_t* pending)
+{
+	uint32_t enabled = (uint8_t)~master_mask | ((uint8_t)~slave_mask << 8);
+
+	master_mask = 0xFF & ~(1 << SLAVE_IRQ_LINE);
+	slave_mask = 0xFF;
+	outb(master_mask, MASTER_8259_PORT2);
+	outb(slave_mask, SLAVE_8259_PORT2);
+
+	/* OCW3: the next read of the command port returns the interrupt request register */
+	outb(OCW3_READ_IRR, MASTER_8259_PORT);
+	outb(OCW3_READ_IRR, SLAVE_8259_PORT);
+	*pending = inb(MASTER_8259_PORT) | (inb(SLAVE_8259_PORT) << 8);
+	return enabled;
+}
+
+/*	Function: i8259_enable_irq(uint32_t irq_num)
 *	Description: Enable (unmask) the specified IRQ
 *	input: irq_num -- the number of the IRQ line to operate on
 *	output: none
@@ -59,7 +118,7 @@ i8259_init(void)
 * 			 writing an updated mask to the data port
 */
 void
-enable_irq(uint32_t irq_num)
+i8259_enable_irq(uint32_t irq_num)
 {
 	// Masking and unmasking of interrupts on an 8259A outside of the 
 	//interrupt sequence requires only a single write to the second port and 
@@ -99,7 +158,7 @@ enable_irq(uint32_t irq_num)
  	} 
 }
 
-/*	Function: disable_irq(uint32_t irq_num)
+/*	Function: i8259_disable_irq(uint32_t irq_num)
 *	Description: Disable (mask) the specified IRQ
 *	input: irq_num -- the number of the IRQ line to operate on
 *	output: none
@@ -107,7 +166,7 @@ enable_irq(uint32_t irq_num)
 * 			 writing an updated mask to the data port
 */
 void
-disable_irq(uint32_t irq_num)
+i8259_disable_irq(uint32_t irq_num)
 {
 	/* Ret if irq_num is invalid */ 
  	if ((irq_num > 15) || (irq_num < 0)) { 
@@ -141,7 +200,7 @@ disable_irq(uint32_t irq_num)
  	} 
 }
 
-/*	Function: send_eoi(uint32_t irq_num)
+/*	Function: i8259_send_eoi(uint32_t irq_num)
 *	Description: Send end-of-interrupt signal for the specified IRQ
 *	input: irq_num -- the number of the IRQ line to operate on
 *	output: none
@@ -149,7 +208,7 @@ disable_irq(uint32_t irq_num)
 *			 sends it out to the PIC 
 */
 void
-send_eoi(uint32_t irq_num)
+i8259_send_eoi(uint32_t irq_num)
 {
 	/* MASTER BOUNDS = 0 -> 7 */
 	if ((irq_num >= 0) && (irq_num <= 7)) { 
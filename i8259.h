@@ -31,15 +31,25 @@
  * to declare the interrupt finished */
 #define EOI             0x60
 
+/* OCW3 asking for the interrupt request register on the next read */
+#define OCW3_READ_IRR   0x0A
+
 /* Externally-visible functions */
 
 /* Initialize both PICs */
 void i8259_init(void);
-/* Enable (unmask) the specified IRQ */
+/* Enable (unmask) the specified IRQ, on the I/O APIC once it delivers the IRQs */
 void enable_irq(uint32_t irq_num);
 /* Disable (mask) the specified IRQ */
 void disable_irq(uint32_t irq_num);
 /* Send end-of-interrupt signal for the specified IRQ */
 void send_eoi(uint32_t irq_num);
 
+/* The same on the 8259s whether or not the I/O APIC delivers the IRQs */
+void i8259_enable_irq(uint32_t irq_num);
+void i8259_disable_irq(uint32_t irq_num);
+void i8259_send_eoi(uint32_t irq_num);
+/* Mask every line when the I/O APIC takes over, returning the enabled ones */
+uint32_t i8259_mask_all(uint32_t* pending);
+
 #endif /* _I8259_H */
@@ -6,6 +6,7 @@
 #include "lib.h"
 #include "i8259.h"
 #include "interrupts.h"
+#include "apic.h"
 
 #define SYSCALL_VECTOR		0x80
 #define RTC_VECTOR			0x28
@@ -24,18 +25,19 @@ EXCEPTION_THROWN(INT3_EXCEPTION,"Breakpoint Exception");
 EXCEPTION_THROWN(OVERFLOW_EXCEPTION,"Overflow Exception");
 EXCEPTION_THROWN(BOUNDS_EXCEPTION,"BOUND Range Exceeded Exception");
 EXCEPTION_THROWN(INVALID_OPCODE_EXCEPTION,"Invalid Opcode Exception");
-EXCEPTION_THROWN(DEVICE_NOT_AVAILABLE_EXCEPTION,"Device Not Available Exception");
 EXCEPTION_THROWN(DOUBLE_FAULT_EXCEPTION,"Double Fault Exception");
 EXCEPTION_THROWN(COPROCESSOR_SEGMENT_OVERRUN_EXCEPTION,"Coprocessor Segment Exception");
 EXCEPTION_THROWN(TSS_EXCEPTION,"Invalid TSS Exception");
 EXCEPTION_THROWN(SEG_NOT_PRESENT_EXCEPTION,"Segment Not Present");
 EXCEPTION_THROWN(STACK_SEGMENT_EXCEPTION,"Stack Fault Exception");
 EXCEPTION_THROWN(GENERAL_PROTECTION_EXCEPTION,"General Protection Exception");
+/* Page faults go through page_fault_handler, which calls this when it cannot handle one */
 EXCEPTION_THROWN(PAGE_FAULT_EXCEPTION,"Page Fault Exception");
 /**15 - RESERVED BY INTEL (?) */
 EXCEPTION_THROWN(FLOAT_EXCEPTION,"Floating Point Exception");
 EXCEPTION_THROWN(ALIGN_CHECK_EXCEPTION,"Alignment Check Exception");
 EXCEPTION_THROWN(MACHINE_CHECK_EXCEPTION,"Machine Check Exception");
+EXCEPTION_THROWN(SIMD_EXCEPTION,"SIMD Floating Point Exception");
 
 
 /* Function: general_interruption()
@@ -123,18 +125,20 @@ init_interrupts(void)
 	SET_IDT_ENTRY(idt[4], OVERFLOW_EXCEPTION);
 	SET_IDT_ENTRY(idt[5], BOUNDS_EXCEPTION);
 	SET_IDT_ENTRY(idt[6], INVALID_OPCODE_EXCEPTION);
-	SET_IDT_ENTRY(idt[7], DEVICE_NOT_AVAILABLE_EXCEPTION);
+	/* Lazy FPU switching - start in interrupts.S */
+	SET_IDT_ENTRY(idt[7], device_not_available_handler);
 	SET_IDT_ENTRY(idt[8], DOUBLE_FAULT_EXCEPTION);
 	SET_IDT_ENTRY(idt[9], COPROCESSOR_SEGMENT_OVERRUN_EXCEPTION);
 	SET_IDT_ENTRY(idt[10], TSS_EXCEPTION);
 	SET_IDT_ENTRY(idt[11], SEG_NOT_PRESENT_EXCEPTION);
 	SET_IDT_ENTRY(idt[12], STACK_SEGMENT_EXCEPTION);
 	SET_IDT_ENTRY(idt[13], GENERAL_PROTECTION_EXCEPTION);
-	SET_IDT_ENTRY(idt[14], PAGE_FAULT_EXCEPTION);
+	SET_IDT_ENTRY(idt[14], page_fault_handler);
 	//Interrupt Vector #15 - RESERVED BY INTEL
 	SET_IDT_ENTRY(idt[16], FLOAT_EXCEPTION);
 	SET_IDT_ENTRY(idt[17], ALIGN_CHECK_EXCEPTION);
 	SET_IDT_ENTRY(idt[18], MACHINE_CHECK_EXCEPTION);
+	SET_IDT_ENTRY(idt[19], SIMD_EXCEPTION);
 	
 	/*RTC Interrupt Handler - start in interrupts.S */
 	SET_IDT_ENTRY(idt[RTC_VECTOR], rtc_handler);
@@ -145,6 +149,14 @@ init_interrupts(void)
 	/*Keyboard Interrupt Handler - start in interrupts.S */
 	SET_IDT_ENTRY(idt[PIT_VECTOR], pit_handler);
 
+	/*Local APIC Timer Interrupt Handler - start in interrupts.S */
+	SET_IDT_ENTRY(idt[LAPIC_TIMER_VECTOR], lapic_timer_handler);
+
+	/*Inter-processor interrupts and the local APIC's spurious vector - start in interrupts.S */
+	SET_IDT_ENTRY(idt[TLB_FLUSH_VECTOR], tlb_flush_handler);
+	SET_IDT_ENTRY(idt[RESCHEDULE_VECTOR], reschedule_handler);
+	SET_IDT_ENTRY(idt[SPURIOUS_VECTOR], spurious_handler);
+
 	/*System Call Interrupt Handler - start in interrupts.S */
 	SET_IDT_ENTRY(idt[SYSCALL_VECTOR], system_call_handler);
    // Load the IDT.
@@ -7,4 +7,7 @@
   */
 int init_interrupts(void);
 
+/* Blue screen for page faults handle_page_fault can not service */
+void PAGE_FAULT_EXCEPTION();
+
 #endif
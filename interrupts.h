@@ -14,8 +14,25 @@ extern void rtc_handler();
 /* PIT interrupt asm wrapper */
 extern void pit_handler();
 
+/* Local APIC timer interrupt asm wrapper */
+extern void lapic_timer_handler();
+
+/* Device not available (#NM) asm wrapper */
+extern void device_not_available_handler();
+
+/* Inter-processor interrupt asm wrappers */
+extern void tlb_flush_handler();
+extern void reschedule_handler();
+extern void spurious_handler();
+
+/* Page fault asm wrapper */
+extern void page_fault_handler();
+
 /* System Call asm wrapper */
 extern void system_call_handler();
 
+/* sysenter System Call entry */
+extern void sysenter_handler();
+
 #endif /* INTERRUPT_HANDLER_H */
 
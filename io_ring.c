@@ -0,0 +1,69 @@
+/*
+*   io_ring.c - the io_ring_enter system call. Operations run in order, through the same functions as
+*   their system calls, so they check their file descriptors against pcb->fds[] the same way. One that
+*   blocks (a terminal or RTC read) holds up the ones behind it
+*/
+
+#include "io_ring.h"
+#include "system_calls.h"
+#include "types.h"
+
+/*
+*   Function: io_ring_op
+*   Description: runs one queued operation
+*   inputs: sqe -- the operation, copied out of the ring
+*   outputs: the operation's result
+*/
+static int32_t
+io_ring_op(const io_sqe_t * sqe)
+{
+	switch (sqe->op) {
+	case IO_OP_READ:
+		return read(sqe->fd, (void *)sqe->buf, sqe->nbytes);
+	case IO_OP_WRITE:
+		return write(sqe->fd, (const void *)sqe->buf, sqe->nbytes);
+	case IO_OP_OPEN:
+		return open((const uint8_t *)sqe->buf);
+	case IO_OP_CLOSE:
+		return close(sqe->fd);
+	default:
+		return -1;
+	}
+}
+
+/*
+*   Function: io_ring_enter
+*   Description: takes operations off the submission ring until it is empty or the completion ring is
+*                full, and posts each result to the completion ring. sq_head and cq_tail move on after
+*                every operation, so a program sees the ones done before a fault ended it
+*   inputs: ring -- the program's rings, all inside its memory
+*   outputs: the number of operations run, -1 if ring is not in the program's memory or its indices
+*            are impossible
+*/
+int32_t
+io_ring_enter(io_ring_t * ring)
+{
+	io_sqe_t sqe;
+	io_cqe_t * cqe;
+	uint32_t sq_head, cq_tail;
+	int32_t done = 0;
+
+	if ((uint32_t)ring < _128MB || (uint32_t)ring > _132MB - sizeof(io_ring_t))
+		return -1;
+	sq_head = ring->sq_head;
+	cq_tail = ring->cq_tail;
+	if (ring->sq_tail - sq_head > IO_RING_ENTRIES || cq_tail - ring->cq_head > IO_RING_ENTRIES)
+		return -1;
+
+	while (sq_head != ring->sq_tail && cq_tail - ring->cq_head < IO_RING_ENTRIES) {
+		sqe = ring->sq[sq_head & IO_RING_MASK];
+		ring->sq_head = ++sq_head;
+
+		cqe = &ring->cq[cq_tail & IO_RING_MASK];
+		cqe->user_data = sqe.user_data;
+		cqe->result = io_ring_op(&sqe);
+		ring->cq_tail = ++cq_tail;
+		done++;
+	}
+	return done;
+}
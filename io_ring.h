@@ -0,0 +1,61 @@
+/*
+*	io_ring.h - submission and completion rings for batching read, write, open and close. A program
+*	keeps an io_ring_t in its own memory, queues operations on it and runs the whole batch with a
+*	single io_ring_enter system call
+*/
+#ifndef _IO_RING_H
+#define _IO_RING_H
+
+#include "types.h"
+
+/* Entries in each ring, a power of two */
+#define IO_RING_ENTRIES		32
+#define IO_RING_MASK		(IO_RING_ENTRIES - 1)
+
+/* Operations, each runs the system call of the same name */
+#define IO_OP_READ			1
+#define IO_OP_WRITE			2
+#define IO_OP_OPEN			3
+#define IO_OP_CLOSE			4
+
+/*** Struct: io_sqe_t - a queued operation
+*    op - IO_OP_*
+*    fd - file descriptor (read, write, close)
+*    buf - buffer (read, write) or file name (open)
+*    nbytes - bytes to read or write
+*    user_data - handed back unchanged in the completion
+***/
+typedef struct io_sqe {
+	uint32_t op;
+	int32_t fd;
+	uint32_t buf;
+	int32_t nbytes;
+	uint32_t user_data;
+} io_sqe_t;
+
+/*** Struct: io_cqe_t - the result of an operation
+*    user_data - from the operation
+*    result - what the system call returned, -1 for an unknown op
+***/
+typedef struct io_cqe {
+	uint32_t user_data;
+	int32_t result;
+} io_cqe_t;
+
+/*** Struct: io_ring_t - the rings. Indices count up forever, entry i is at i & IO_RING_MASK
+*    sq_head - next operation the kernel takes, sq_tail - one past the last the program queued
+*    cq_head - next completion the program takes, cq_tail - one past the last the kernel posted
+***/
+typedef struct io_ring {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	io_sqe_t sq[IO_RING_ENTRIES];
+	io_cqe_t cq[IO_RING_ENTRIES];
+} io_ring_t;
+
+/* io_ring_enter System Call: runs the queued operations, returns how many or -1 */
+int32_t io_ring_enter(io_ring_t * ring);
+
+#endif /* _IO_RING_H */
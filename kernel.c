@@ -17,6 +17,12 @@
 #include "interrupts.h"
 #include "system_calls.h"
 #include "scheduling.h"
+#include "benchmark.h"
+#include "frames.h"
+#include "slab.h"
+#include "fpu.h"
+#include "smp.h"
+#include "time_page.h"
 
 /* Macros. */
 /* Check if the bit BIT in FLAGS is set. */
@@ -29,6 +35,8 @@ void
 entry (unsigned long magic, unsigned long addr)
 {
 	multiboot_info_t *mbi;
+	uint32_t tick_hz = PIT_DEFAULT_HZ;
+	uint32_t slice_ms = DEFAULT_SLICE_MS;
 
 	/* Clear the screen. */
 	clear();
@@ -56,8 +64,12 @@ entry (unsigned long magic, unsigned long addr)
 		printf ("boot_device = 0x%#x\n", (unsigned) mbi->boot_device);
 
 	/* Is the command line passed? */
-	if (CHECK_FLAG (mbi->flags, 2))
+	if (CHECK_FLAG (mbi->flags, 2)) {
 		printf ("cmdline = %s\n", (char *) mbi->cmdline);
+		/* "hz=" and "slice=" (ms) pick the tick rate and time slice, read them before paging hides low memory */
+		tick_hz = cmdline_option((int8_t *) mbi->cmdline, "hz=", PIT_DEFAULT_HZ);
+		slice_ms = cmdline_option((int8_t *) mbi->cmdline, "slice=", DEFAULT_SLICE_MS);
+	}
 
 	if (CHECK_FLAG (mbi->flags, 3)) {
 		int mod_count = 0;
@@ -75,6 +87,9 @@ entry (unsigned long magic, unsigned long addr)
 			mod_count++;
 			mod++;
 		}
+		/* Index the filesystem now that we know where it lives */
+		if (mbi->mods_count > 0)
+			init_filesystem();
 	}
 	/* Bits 4 and 5 are mutually exclusive! */
 	if (CHECK_FLAG (mbi->flags, 4) && CHECK_FLAG (mbi->flags, 5))
@@ -104,7 +119,7 @@ entry (unsigned long magic, unsigned long addr)
 		for (mmap = (memory_map_t *) mbi->mmap_addr;
 				(unsigned long) mmap < mbi->mmap_addr + mbi->mmap_length;
 				mmap = (memory_map_t *) ((unsigned long) mmap
-					+ mmap->size + sizeof (mmap->size)))
+					+ mmap->size + sizeof (mmap->size))) {
 			printf (" size = 0x%x,     base_addr = 0x%#x%#x\n"
 					"     type = 0x%x,  length    = 0x%#x%#x\n",
 					(unsigned) mmap->size,
@@ -113,7 +128,25 @@ entry (unsigned long magic, unsigned long addr)
 					(unsigned) mmap->type,
 					(unsigned) mmap->length_high,
 					(unsigned) mmap->length_low);
+			/* Type 1 is available RAM, anything above 4GB is out of reach */
+			if (mmap->type == 1 && mmap->base_addr_high == 0)
+				add_free_frames(mmap->base_addr_low,
+						mmap->length_high ? 0 : mmap->base_addr_low + mmap->length_low);
+		}
+	}
+	/* No memory map, fall back to the upper memory size */
+	else if (CHECK_FLAG (mbi->flags, 0))
+		add_free_frames(_1MB, _1MB + mbi->mem_upper * 1024);
+
+	/* Take back what is already in use: low memory and the kernel, the modules */
+	reserve_frames(0, _8MB);
+	if (CHECK_FLAG (mbi->flags, 3)) {
+		unsigned int i;
+		module_t* mod = (module_t*)mbi->mods_addr;
+		for (i = 0; i < mbi->mods_count; i++, mod++)
+			reserve_frames(mod->mod_start, mod->mod_end);
 	}
+	printf ("%u free frames\n", free_frame_count());
 
 	/* Construct an LDT entry in the GDT */
 	{
@@ -176,12 +209,39 @@ entry (unsigned long magic, unsigned long addr)
 	/* Turn on paging */
     init_paging();
 
+	/* Kernel heap, it reaches its frames through the direct map set up by init_paging */
+	init_slab();
+	init_pcb_cache();
+
+	/* x87/SSE for user programs, switched lazily */
+	init_fpu();
+
+	/* From here on this thread is the idle task */
+	init_idle_task();
+
     /* Turn on the PIT */
-    init_PIT();
+    init_PIT(tick_hz, slice_ms);
+
+	/* The time page every process can read the time from, at the tick rate just set */
+	init_time_page();
+
+	/* Start the other processors. This thread runs kernel code from here on, so it takes the
+	 * kernel lock first; starting the first task gives it up */
+	lock_kernel();
+	init_smp();
+
+	/* System calls through sysenter too, it needs the processor's TSS from init_smp */
+	init_sysenter();
 
-	/* Setup multiple terminals - THIS IS WHERE WE LAUNCH OUR FIRST SHELL*/
+#ifdef BENCHMARK
+	/* Benchmark builds report their numbers instead of starting the shells */
+	run_benchmarks();
+#else
+	/* Setup multiple terminals - THIS IS WHERE WE LAUNCH OUR FIRST SHELL.
+	 * It returns the first time there is nothing to run */
     init_terms();
+#endif
 
-	/* Spin (nicely, so we don't chew up cycles) */
-	asm volatile(".1: hlt; jmp .1;");
+	/* Halt (nicely, so we don't chew up cycles) until there is something to run */
+	idle_loop();
 }
@@ -9,6 +9,7 @@
 #include "x86_desc.h"
 #include "system_calls.h"
 #include "terminal.h"
+#include "stats.h"
 
 /*
 Notes/References:
@@ -193,6 +194,9 @@ handle_key_press(uint8_t scancode) {
 			case 'c':
 				return;
 				break;
+			case 't':
+				print_kernel_stats();
+				break;
 		}
 	}
 
@@ -242,7 +246,9 @@ clear_key_buffer() {
 */
 void 
 handle_enter() {
-	get_pcb_ptr_process(terms[current_term_id].active_process_number)->term->enter_flag = 1;
+	term_t * term = get_pcb_ptr_process(terms[current_term_id].active_process_number)->term;
+	term->enter_flag = 1;
+	wake_up_all(&term->read_queue);
 	key_buffer[key_buffer_idx++] = '\n';
 	enter();
 }
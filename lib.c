@@ -8,10 +8,22 @@
 #include "scheduling.h"
 
 
-/* Global Variables: Updating information about */
-static int screen_x;
-static int screen_y;
+/* Global Variables: Updating information about the displayed terminal, whose video memory
+ * starts at video_mem (see set_screen_mem) */
+static uint32_t screen_x;
+static uint32_t screen_y;
 static char* video_mem = (char *)VIDEO;
+/* Cell of video_mem at the top left of the screen. Scrolling moves it down a row, and the CRTC start
+ * address with it, until the screen reaches the end of the terminal's video memory and is copied back */
+static uint32_t screen_origin = 0;
+
+/* Address of the cell at column x, row y of the screen, and of the executing terminal's screen */
+#define SCREEN_CELL(x, y)	(video_mem + ((screen_origin + NUM_COLS*(y) + (x)) << 1))
+#define TERM_EXEC_CELL(x, y)	(terms[current_term_executing].video_mem + \
+	((terms[current_term_executing].origin + NUM_COLS*(y) + (x)) << 1))
+
+/* Cell of video memory the display starts at */
+#define SCREEN_START	(((uint32_t)video_mem - VIDEO) / 2 + screen_origin)
 
 /*
 *	Function: get_screen_x()
@@ -105,12 +117,111 @@ set_screen_pos_term_exec(uint32_t x, uint32_t y) {
 
 /*
 * void set_cursor_pos(void);
-*   Special print function to write to the currently executing terminal's video buffer
+*   Moves the hardware cursor to the screen position text is drawn at
 */
 void set_cursor_pos() {
-		uint16_t position = NUM_COLS*screen_y + screen_x;
-		outw(0x000E | (position & 0xFF00), 0x03D4);
-		outw(0x000F | ((position << 8) & 0xFF00), 0x03D4);
+		uint16_t position = SCREEN_START + NUM_COLS*screen_y + screen_x;
+		outw(CRTC_CURSOR_HIGH | (position & 0xFF00), VGA_CRTC_INDEX);
+		outw(CRTC_CURSOR_LOW | ((position << 8) & 0xFF00), VGA_CRTC_INDEX);
+}
+
+/*
+* void set_screen_start(void);
+*   Points the CRTC start address at the top of the screen, the display shows the screen from there
+*/
+static void set_screen_start(void) {
+		uint16_t start = SCREEN_START;
+		outw(CRTC_START_HIGH | (start & 0xFF00), VGA_CRTC_INDEX);
+		outw(CRTC_START_LOW | ((start << 8) & 0xFF00), VGA_CRTC_INDEX);
+}
+
+/*
+* void set_screen_mem(uint8_t* mem, uint32_t origin);
+*   Inputs: mem = video memory of the terminal to display
+*			origin = cell of mem at the top left of its screen
+*	Function: displays another terminal by pointing the CRTC at its video memory, nothing is copied.
+*			  The caller moves the cursor with set_screen_pos
+*/
+void set_screen_mem(uint8_t* mem, uint32_t origin) {
+	video_mem = (char *)mem;
+	screen_origin = origin;
+	set_screen_start();
+}
+
+/*
+* uint32_t get_screen_origin(void);
+*   Return Value: the cell of the displayed terminal's video memory at the top left of the screen
+*/
+uint32_t get_screen_origin(void) {
+	return screen_origin;
+}
+
+/*
+* void scroll_term_mem(char* mem, uint32_t* origin, uint8_t term_id);
+*   Inputs: mem = a terminal's video memory
+*			origin = cell of mem at the top left of its screen, moved by the scroll
+*			term_id = the terminal
+*	Function: scrolls a terminal's screen up a line by moving its top down a row. Only when that
+*			  runs past the terminal's TERM_VIDEO_ROWS are the rows copied, back to the start.
+*			  While a process of the terminal has vidmap the screen stays on the page it maps,
+*			  so the rows are always copied up instead
+*/
+static void
+scroll_term_mem(char* mem, uint32_t* origin, uint8_t term_id) {
+	uint8_t attrib = term_attribs[term_id];
+
+	if (terms[term_id].vidmaps) {
+		memmove(mem + (*origin << 1), mem + ((*origin + NUM_COLS) << 1), 2*NUM_COLS*(NUM_ROWS-1));
+	} else if (*origin + NUM_COLS*(NUM_ROWS+1) > NUM_COLS*TERM_VIDEO_ROWS) {
+		memcpy(mem, mem + ((*origin + NUM_COLS) << 1), 2*NUM_COLS*(NUM_ROWS-1));
+		*origin = 0;
+	} else {
+		*origin += NUM_COLS;
+	}
+
+	// Clear the bottom line
+	memset_word(mem + ((*origin + NUM_COLS*(NUM_ROWS-1)) << 1), ' ' | (attrib << 8), NUM_COLS);
+}
+
+/*
+* void reset_term_mem(char* mem, uint32_t* origin);
+*   Moves a terminal's screen back to the start of its video memory
+*/
+static void
+reset_term_mem(char* mem, uint32_t* origin) {
+	if (*origin == 0)
+		return;
+	memmove(mem, mem + (*origin << 1), 2*NUM_ROWS*NUM_COLS);
+	*origin = 0;
+}
+
+/*
+* uint8_t* get_screen_mem(void);
+*   Return Value: the video memory of the top left of the screen, the screen's rows follow it
+*/
+uint8_t* get_screen_mem(void) {
+	return (uint8_t *)SCREEN_CELL(0, 0);
+}
+
+/*
+* void reset_screen_start(void);
+*   Moves the screen back to the start of the terminal's video memory, the page vidmap maps.
+*   Interrupts must be off
+*/
+void reset_screen_start(void) {
+	if (screen_origin == 0)
+		return;
+	reset_term_mem(video_mem, &screen_origin);
+	set_screen_start();
+	set_cursor_pos();
+}
+
+/*
+* void reset_screen_start_term_exec(void);
+*   Special print function to move the currently executing terminal's screen back to the start
+*/
+void reset_screen_start_term_exec(void) {
+	reset_term_mem((char *)terms[current_term_executing].video_mem, &terms[current_term_executing].origin);
 }
 
 /*
@@ -122,16 +233,9 @@ void set_cursor_pos() {
 void
 clear(void)
 {
-    int32_t i;
-    for(i=0; i<NUM_ROWS*NUM_COLS; i++) {
-        *(uint8_t *)(video_mem + (i << 1)) = ' ';
-        if (current_term_id == TERMINAL_ONE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM1;
-        if (current_term_id == TERMINAL_TWO)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM2;
-        if (current_term_id == TERMINAL_THREE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM3;
-    }
+    screen_origin = 0;
+    set_screen_start();
+    memset_word(video_mem, ' ' | (term_attribs[current_term_id] << 8), NUM_ROWS*NUM_COLS);
 }
 
 /*
@@ -167,42 +271,20 @@ void backspace(void) {
 		set_screen_x(screen_x-1);
 	}
 
-	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1)) = ' ';
-    if (current_term_id == TERMINAL_ONE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM1;
-        if (current_term_id == TERMINAL_TWO)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM2;
-        if (current_term_id == TERMINAL_THREE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM3;
+	*(uint8_t *)SCREEN_CELL(screen_x, screen_y) = ' ';
+	*(uint8_t *)(SCREEN_CELL(screen_x, screen_y) + 1) = term_attribs[current_term_id];
 }
 
 /*
 * void scroll_up(void);
 *   Inputs: void
 *   Return Value: none
-*	Function: Removes a character from the screen
+*	Function: Scrolls the screen up a line by moving its start in video memory down a row
 */
 void 
 scroll_up() {
-	int32_t x;
-	int32_t y;
-	int32_t old_line;
-	int32_t new_line;
-
-	// Move each row in the video memory up by 1
-	for (y = 0; y < NUM_ROWS-1; y++) {
-		for (x = 0; x < NUM_COLS; x++) {
-			old_line = NUM_COLS*(y+1) + x;
-			new_line = NUM_COLS*y + x;
-			*(uint8_t *)(video_mem + (new_line << 1)) = *(uint8_t *)(video_mem + (old_line << 1));
-		}
-	}
-
-	// Clear the bottom line
-	for (x = 0; x < NUM_COLS; x++) {
-		new_line = NUM_COLS*(NUM_ROWS-1) + x;
-		*(uint8_t *)(video_mem + (new_line << 1)) = ' ';
-	}
+	scroll_term_mem(video_mem, &screen_origin, current_term_id);
+	set_screen_start();
 	set_screen_x(ROW_START);
 }
 
@@ -212,26 +294,103 @@ scroll_up() {
 */
 void
 scroll_up_term_exec() {
-	int32_t x;
-	int32_t y;
-	int32_t old_line;
-	int32_t new_line;
-
-	// Move each row in the video memory up by 1
-	for (y = 0; y < NUM_ROWS-1; y++) {
-		for (x = 0; x < NUM_COLS; x++) {
-			old_line = NUM_COLS*(y+1) + x;
-			new_line = NUM_COLS*y + x;
-			*(uint8_t *)(terms[current_term_executing].video_mem + (new_line << 1)) = *(uint8_t *)(terms[current_term_executing].video_mem + (old_line << 1));
+	scroll_term_mem((char *)terms[current_term_executing].video_mem, &terms[current_term_executing].origin,
+					current_term_executing);
+	set_screen_pos_term_exec(ROW_START, terms[current_term_executing].y_pos);
+}
+
+/* Bytes write_term_mem acts on instead of showing */
+#define IS_CONTROL_BYTE(c)	((c) == '\n' || (c) == '\r' || (c) == '\t' || (c) == '\b')
+
+/*
+* void write_term_mem(char* mem, uint32_t* origin, uint32_t* x, uint32_t* y, uint8_t term_id,
+*					  const uint8_t* buf, int32_t nbytes);
+*   Inputs: mem, origin = a terminal's video memory and the cell of it at the top left of its screen
+*			x, y = the terminal's position, moved past the text
+*			term_id = the terminal
+*			buf, nbytes = the bytes to write, all of them whatever their value
+*	Function: writes raw bytes to a terminal's screen. Runs of printable bytes go into the cells a row
+*			  at a time; \n moves to the next line, \r to the start of the line, \t to the next tab stop
+*			  and \b back a column. Other bytes are shown as their glyphs. Neither the CRTC start address
+*			  nor the cursor is touched
+*/
+static void
+write_term_mem(char* mem, uint32_t* origin, uint32_t* x, uint32_t* y, uint8_t term_id,
+			   const uint8_t* buf, int32_t nbytes)
+{
+	uint16_t* cell;
+	uint16_t attrib_word = term_attribs[term_id] << 8;
+	int32_t run;
+
+	while (nbytes > 0) {
+		if (IS_CONTROL_BYTE(*buf)) {
+			switch (*buf) {
+				case '\n':
+					*x = NUM_COLS;
+					break;
+				case '\r':
+					*x = ROW_START;
+					break;
+				case '\t':
+					run = TAB_WIDTH - *x % TAB_WIDTH;
+					memset_word(mem + ((*origin + NUM_COLS*(*y) + *x) << 1), ' ' | attrib_word, run);
+					*x += run;
+					break;
+				case '\b':
+					if (*x > ROW_START)
+						(*x)--;
+					break;
+			}
+			buf++;
+			nbytes--;
+		} else {
+			/* The printable bytes up to the end of the row */
+			cell = (uint16_t *)(mem + ((*origin + NUM_COLS*(*y) + *x) << 1));
+			for (run = 0; run < nbytes && *x + run < NUM_COLS && !IS_CONTROL_BYTE(buf[run]); run++)
+				cell[run] = buf[run] | attrib_word;
+			*x += run;
+			buf += run;
+			nbytes -= run;
 		}
-	}
 
-	// Clear the bottom line
-	for (x = 0; x < NUM_COLS; x++) {
-		new_line = NUM_COLS*(NUM_ROWS-1) + x;
-		*(uint8_t *)(terms[current_term_executing].video_mem + (new_line << 1)) = ' ';
+		/* Past the end of the row (or a newline): next line, scrolling at the bottom */
+		if (*x >= NUM_COLS) {
+			*x = ROW_START;
+			if (*y < NUM_ROWS - 1)
+				(*y)++;
+			else
+				scroll_term_mem(mem, origin, term_id);
+		}
 	}
-	set_screen_pos_term_exec(ROW_START, terms[current_term_executing].y_pos);
+}
+
+/*
+* int32_t write_screen(const uint8_t* buf, int32_t nbytes);
+*   Inputs: buf, nbytes = the bytes to write
+*   Return Value: nbytes
+*	Function: writes raw bytes to the screen (see write_term_mem), then moves the CRTC start address and
+*			  the cursor once for all of them
+*/
+int32_t
+write_screen(const uint8_t* buf, int32_t nbytes)
+{
+	write_term_mem(video_mem, &screen_origin, &screen_x, &screen_y, current_term_id, buf, nbytes);
+	set_screen_start();
+	set_cursor_pos();
+	return nbytes;
+}
+
+/*
+* int32_t write_screen_term_exec(const uint8_t* buf, int32_t nbytes);
+*   Special print function to write raw bytes to the currently executing terminal's video buffer
+*/
+int32_t
+write_screen_term_exec(const uint8_t* buf, int32_t nbytes)
+{
+	term_t* term = &terms[current_term_executing];
+	write_term_mem((char *)term->video_mem, &term->origin, &term->x_pos, &term->y_pos,
+				   current_term_executing, buf, nbytes);
+	return nbytes;
 }
 
 /* Standard printf().
@@ -507,13 +666,8 @@ putc(uint8_t c)
     if(c == '\n' || c == '\r') {
         enter();
     } else {
-        *(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1)) = c;
-        if (current_term_id == TERMINAL_ONE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM1;
-        if (current_term_id == TERMINAL_TWO)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM2;
-        if (current_term_id == TERMINAL_THREE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM3;
+        *(uint8_t *)SCREEN_CELL(screen_x, screen_y) = c;
+        *(uint8_t *)(SCREEN_CELL(screen_x, screen_y) + 1) = term_attribs[current_term_id];
         set_screen_pos(screen_x+1, screen_y);
     }
 }
@@ -548,13 +702,8 @@ putc_terminal_running(uint8_t c)
     if(c == '\n' || c == '\r') {
         enter_term_exec();
     } else {
-        *(uint8_t *)(terms[current_term_executing].video_mem + ((NUM_COLS*terms[current_term_executing].y_pos + terms[current_term_executing].x_pos) << 1)) = c;
-        if (current_term_id == TERMINAL_ONE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM1;
-        if (current_term_id == TERMINAL_TWO)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM2;
-        if (current_term_id == TERMINAL_THREE)
-        	*(uint8_t *)(video_mem + ((NUM_COLS*screen_y + screen_x) << 1) + 1) = ATTRIB_TERM3;
+        *TERM_EXEC_CELL(terms[current_term_executing].x_pos, terms[current_term_executing].y_pos) = c;
+        *(TERM_EXEC_CELL(terms[current_term_executing].x_pos, terms[current_term_executing].y_pos) + 1) = term_attribs[current_term_executing];
         set_screen_pos_term_exec(terms[current_term_executing].x_pos+1, terms[current_term_executing].y_pos);
     }
 }
@@ -899,6 +1048,38 @@ strncpy(int8_t* dest, const int8_t* src, uint32_t n)
 	return dest;
 }
 
+/*
+* uint32_t cmdline_option(const int8_t* cmdline, const int8_t* key, uint32_t def)
+*   Inputs: const int8_t* cmdline = boot command line, words separated by spaces
+*			const int8_t* key = option name including the '=', e.g. "hz="
+*			uint32_t def = value when the option is missing or not a number
+*   Return Value: the decimal value following the key
+*	Function: reads a numeric key=value option from the boot command line
+*/
+uint32_t
+cmdline_option(const int8_t* cmdline, const int8_t* key, uint32_t def)
+{
+	uint32_t len = strlen(key);
+	uint32_t value;
+	int32_t i = 0;
+
+	if (cmdline == NULL)
+		return def;
+	while (cmdline[i] != '\0') {
+		/* Start of a word */
+		if ((i == 0 || cmdline[i-1] == ' ') && strncmp(&cmdline[i], key, len) == 0) {
+			i += len;
+			if (cmdline[i] < '0' || cmdline[i] > '9')
+				return def;
+			for (value = 0; cmdline[i] >= '0' && cmdline[i] <= '9'; i++)
+				value = value * 10 + (cmdline[i] - '0');
+			return value;
+		}
+		i++;
+	}
+	return def;
+}
+
 /*
 * void turn_screen_blue(void)
 *   Inputs: nothing
@@ -12,11 +12,22 @@
 #define NUM_ROWS 25
 #define ROW_START 0
 #define VIDEO_SIZE	(NUM_COLS*NUM_ROWS)
+#define TAB_WIDTH 8
 #define ATTRIB_TERM1 0xf
 #define ATTRIB_TERM2 0x4
 #define ATTRIB_TERM3 0x2
 #define BLUESCREEN 0x16
 
+/* Text mode video memory, the terminals' screens (see TERM_VIDEO_SIZE) */
+#define VGA_TEXT_SIZE	0x8000
+
+/* CRTC index register and the registers for the start of the screen and the cursor, in cells */
+#define VGA_CRTC_INDEX		0x03D4
+#define CRTC_START_HIGH		0x000C
+#define CRTC_START_LOW		0x000D
+#define CRTC_CURSOR_HIGH	0x000E
+#define CRTC_CURSOR_LOW		0x000F
+
 /*Global Vars*/
 extern volatile uint8_t keyboard_enabled;
 
@@ -37,6 +48,10 @@ int32_t puts(int8_t *s);
 
 int32_t puts_terminal_running(int8_t* s);
 
+int32_t write_screen(const uint8_t* buf, int32_t nbytes);
+
+int32_t write_screen_term_exec(const uint8_t* buf, int32_t nbytes);
+
 int8_t *itoa(uint32_t value, int8_t* buf, int32_t radix);
 
 int8_t *strrev(int8_t* s);
@@ -61,6 +76,16 @@ void scroll_up_term_exec();
 
 void set_cursor_pos(void);
 
+uint8_t* get_screen_mem(void);
+
+void set_screen_mem(uint8_t* mem, uint32_t origin);
+
+uint32_t get_screen_origin(void);
+
+void reset_screen_start(void);
+
+void reset_screen_start_term_exec(void);
+
 void turn_screen_blue(void);
 
 void print_cr3(void);
@@ -81,6 +106,8 @@ int8_t* strcpy(int8_t* dest, const int8_t*src);
 
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
 
+uint32_t cmdline_option(const int8_t* cmdline, const int8_t* key, uint32_t def);
+
 void test_interrupts(void);
 
 
@@ -128,6 +155,35 @@ static inline uint32_t inl(port)
 	return val;
 }
 
+/* Reads the 64-bit time stamp counter */
+static inline uint64_t rdtsc(void)
+{
+	uint64_t val;
+	asm volatile("rdtsc"
+			: "=A"(val)
+			:
+			: "memory" );
+	return val;
+}
+
+/* Writes a model specific register */
+static inline void wrmsr(uint32_t msr, uint64_t value)
+{
+	asm volatile("wrmsr"
+			:
+			: "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+/* Divides a 64-bit value by a 32-bit one without libgcc, the quotient has to fit in 32 bits */
+static inline uint32_t div64_32(uint64_t n, uint32_t d)
+{
+	uint32_t q, r;
+	asm("divl %4"
+			: "=a"(q), "=d"(r)
+			: "a"((uint32_t)n), "d"((uint32_t)(n >> 32) % d), "rm"(d));
+	return q;
+}
+
 /* Writes a byte to a port */
 #define outb(data, port)                \
 do {                                    \
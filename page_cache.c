@@ -0,0 +1,77 @@
+/*
+*   page_cache.c - per-inode cache of read-only executable pages. Every process running the
+*   same program maps the same physical copy of its text pages; only writable pages are
+*   loaded into each process's own memory. Frames come from the frame allocator and stay
+*   with their entry once allocated.
+*/
+
+#include "page_cache.h"
+#include "paging.h"
+#include "frames.h"
+#include "lib.h"
+#include "types.h"
+
+/* Cache entries, frame is 0 until an entry is first used */
+static page_cache_entry_t page_cache[PAGE_CACHE_SIZE];
+
+/*
+*   Function: page_cache_get
+*   Description: returns the shared frame holding a read-only page of an executable, loading it
+*                into a free (or unused) cache entry the first time. Takes a reference on the entry
+*   inputs: image -- the executable the page comes from
+*           page -- page aligned user virtual address
+*   outputs: returns the physical address of the frame, or 0 if every entry is in use (or no frame is left,
+*            or the page could not be read)
+*/
+uint32_t
+page_cache_get(const elf_image_t* image, uint32_t page)
+{
+    page_cache_entry_t * victim = NULL;
+    int i;
+
+    for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+        if (page_cache[i].valid && page_cache[i].inode == image->inode && page_cache[i].page == page) {
+            page_cache[i].refcount++;
+            return page_cache[i].frame;
+        }
+        /* Prefer an empty entry, otherwise reuse one nobody has mapped */
+        if (!page_cache[i].valid && (victim == NULL || victim->valid))
+            victim = &page_cache[i];
+        else if (page_cache[i].refcount == 0 && victim == NULL)
+            victim = &page_cache[i];
+    }
+
+    if (victim == NULL)
+        return 0;
+    if (victim->frame == 0 && (victim->frame = alloc_frame()) == 0)
+        return 0;
+
+    /* The entry keeps its frame, but holds no page until one loads */
+    victim->valid = 0;
+    if (elf_load_page(image, page, (uint8_t *)PHYS_TO_VIRT(victim->frame)) != 0)
+        return 0;
+    victim->inode = image->inode;
+    victim->page = page;
+    victim->refcount = 1;
+    victim->valid = 1;
+    return victim->frame;
+}
+
+/*
+*   Function: page_cache_put
+*   Description: drops a reference to a cached page. The page stays cached for the next process
+*                that runs the program until its entry is needed for another page
+*   inputs: frame -- physical address returned by page_cache_get
+*   outputs: none
+*/
+void
+page_cache_put(uint32_t frame)
+{
+    int i;
+    for (i = 0; i < PAGE_CACHE_SIZE; i++) {
+        if (page_cache[i].valid && page_cache[i].frame == frame && page_cache[i].refcount > 0) {
+            page_cache[i].refcount--;
+            return;
+        }
+    }
+}
@@ -0,0 +1,34 @@
+/*
+*	page_cache.h - Function Header File to be used with "page_cache.c"
+*/
+#ifndef _PAGE_CACHE_H
+#define _PAGE_CACHE_H
+
+#include "types.h"
+#include "elf.h"
+
+/* Number of read-only executable pages that can be cached at once */
+#define PAGE_CACHE_SIZE		32
+
+/*** Struct: page_cache_entry_t
+*    inode - inode of the executable the page belongs to
+*    page - user virtual address of the page
+*    frame - physical address of the cached copy
+*    refcount - number of processes that have the page mapped
+*    valid - 1 if the frame holds the page's contents
+***/
+typedef struct {
+	uint32_t inode;
+	uint32_t page;
+	uint32_t frame;
+	uint32_t refcount;
+	uint8_t valid;
+} page_cache_entry_t;
+
+/* Finds or loads the shared copy of a read-only page and takes a reference to it */
+uint32_t page_cache_get(const elf_image_t* image, uint32_t page);
+
+/* Drops a reference taken by page_cache_get */
+void page_cache_put(uint32_t frame);
+
+#endif /* _PAGE_CACHE_H */
@@ -4,6 +4,14 @@
 
 #include "paging.h"
 #include "types.h"
+#include "lib.h"
+#include "elf.h"
+#include "system_calls.h"
+#include "interrupt_table.h"
+#include "page_cache.h"
+#include "smp.h"
+#include "frames.h"
+#include "terminal.h"
 
 //global array for page directory
 // other option is to make it uint32_t
@@ -12,19 +20,30 @@ uint32_t pageDirectory[ONEKILO] __attribute__((aligned(FOURKILO)));
 //global array for page table
 uint32_t pageTable[ONEKILO] __attribute__((aligned(FOURKILO)));
 
-//global array for user page table
-uint32_t userPageTable[ONEKILO] __attribute__((aligned(FOURKILO)));
+//page tables for the vidmap region of each terminal: the first page is the start of the terminal's own
+//part of video memory, displayed or not, so processes never have to be remapped when the display changes
+uint32_t vidMemPageTables[TERM_COUNT][ONEKILO] __attribute__((aligned(FOURKILO)));
 
-//global array for user page table
-uint32_t vidMemPageTable[ONEKILO] __attribute__((aligned(FOURKILO)));
+//page table of the time page region, the same for every process
+uint32_t timePageTable[ONEKILO] __attribute__((aligned(FOURKILO)));
+
+//TLB flush counters: running counts and the last full second sampled by sample_tlb_stats
+static uint32_t tlb_flushes = 0;
+static uint32_t tlb_invlpgs = 0;
+uint32_t tlb_flushes_per_sec = 0;
+uint32_t tlb_invlpgs_per_sec = 0;
 
 
 /*
 *   Function: init_paging()
 *   description: This function should be called in the entry function of kernel.c. It initilizes the
 *                page directory and page table arrays and enables paging by setting the cr3, cr4, cr0 regs.
-*                Memory is mapped one to one for the kernel (4 meg chunk) and video memory (4KB page) and
-*                no other memory is "present".
+*                CR0.WP is set too, so the kernel can not write through read-only (shared) user pages.
+*                pageDirectory is the kernel's template: every process gets a copy of it (see createPageDirectory)
+*                and its kernel mappings are global (CR4.PGE) so they survive the CR3 load of a context switch.
+*                Memory is mapped one to one for the kernel (4 meg chunk) and video memory (4KB page), and all
+*                RAM managed by the frame allocator is mapped at DIRECT_MAP_BASE (supervisor only) so the kernel
+*                can reach any frame it allocates. No other memory is "present".
 *   inputs: none
 *   outputs: none
 *
@@ -49,19 +68,23 @@ init_paging(){
     // attributes: supervisor level, read/write, present
     pageDirectory[0] = ((unsigned int)pageTable) | 3;
     // map second entry to 4MB for Kernel
-    pageDirectory[1] = FOURMEG | 0x83; //attributes: supervisor, present, r/w, size (set to 1 for 4MB page)
-    // create a page table entry for video memory (location 0xB8000 found in lib.c)
-    pageTable[0xB8] |= 3; // attributes: supervisor level, read/write, present.
+    pageDirectory[1] = FOURMEG | 0x183; //attributes: global, supervisor, present, r/w, size (set to 1 for 4MB page)
+    // create page table entries for text mode video memory (location 0xB8000 found in lib.c), all of it as the screen scrolls through it
+    for (i = 0; i < VGA_TEXT_SIZE / FOURKILO; i++)
+        pageTable[VIDEO / FOURKILO + i] |= 0x103; // attributes: global, supervisor level, read/write, present.
+    // direct map of physical memory with 4MB pages
+    for (i = 0; i < (phys_mem_top() + FOURMEG - 1) / FOURMEG; i++)
+        pageDirectory[DIRECT_MAP_BASE / FOURMEG + i] = (i * FOURMEG) | 0x183; //attributes: global, supervisor, present, r/w, 4MB
     
     //turn on paging
     asm volatile(
                  "movl %0, %%eax;"
                  "movl %%eax, %%cr3;"
                  "movl %%cr4, %%eax;"
-                 "orl $0x00000010, %%eax;"
+                 "orl $0x00000090, %%eax;"
                  "movl %%eax, %%cr4;"
                  "movl %%cr0, %%eax;"
-                 "orl $0x80000000, %%eax;"
+                 "orl $0x80010000, %%eax;"
                  "movl %%eax, %%cr0;"
                  :                      /* no outputs */
                  :"r"(pageDirectory)    /* input */
@@ -70,85 +93,65 @@ init_paging(){
 }
 
 /*
- *   Function: remap
- *   description: This function takes virtutal and physical addresses (virtual must be a multiple of 4MB) and maps the 4MB chunk of memory (a single PDE)
- *                begining at the given virtual address to the given physical address
- *   inputs: virtualAddr - multiple of 4MB virtual address to be mapped
- *           physicalAddr - physical address to be mapped
- *   outputs: none
- *
- */
-void remap(uint32_t virtualAddr, uint32_t physicalAddr)
-{
-    uint32_t pde = virtualAddr / FOURMEG;
-    pageDirectory[pde] = physicalAddr | 0x87; //attributes: user, present, r/w, size (set to 1 for 4MB page)
-    flush_tlb();
-}
-
-/*
- *   Function: remapWithPageTable
- *   description: This function takes virtutal and physical addresses (virtual must be a multiple of 4MB) and maps the 4MB chunk of memory (a single PDE)
- *                begining at the given virtual address to the first page of the user page table
- *   inputs: virtualAddr - multiple of 4MB virtual address to be mapped
+ *   Function: mapTerminalVideo
+ *   description: Points the first page of a terminal's vidmap page table at the given physical address,
+ *                the start of the terminal's video memory. Every process of the terminal sees it, as they
+ *                all share the table
+ *   inputs: term - terminal id
  *           physicalAddr - physical address to be mapped
  *   outputs: none
  *
  */
-void remapWithPageTable(uint32_t virtualAddr, uint32_t physicalAddr)
+void mapTerminalVideo(uint32_t term, uint32_t physicalAddr)
 {
-    uint32_t pde = virtualAddr / FOURMEG;
-    // attributes: user level, read/write, present
-    pageDirectory[pde] = ((unsigned int)userPageTable) | 7;
-    userPageTable[0] = physicalAddr | 7; // attributes: user, read/write, present
-    flush_tlb();
+    vidMemPageTables[term][0] = physicalAddr | 7; // attributes: user, read/write, present
+    invalidatePage(VIDMAP_START);
 }
 
 /*
- *   Function: remapVideoWithPageTable
- *   description: This function takes virtutal and physical addresses (virtual must be a multiple of 4MB) and maps the 4MB chunk of memory (a single PDE)
- *                begining at the given virtual address to the first page of the video page table
- *   inputs: virtualAddr - multiple of 4MB virtual address to be mapped
- *           physicalAddr - physical address to be mapped
+ *   Function: mapVidmap
+ *   description: Maps the 4MB region at VIDMAP_START of a process's page directory to the vidmap page table
+ *                of its terminal
+ *   inputs: directory - physical address of the process's page directory
+ *           term - terminal id of the process
  *   outputs: none
  *
  */
-void remapVideoWithPageTable(uint32_t virtualAddr, uint32_t physicalAddr)
+void mapVidmap(uint32_t directory, uint32_t term)
 {
-    uint32_t pde = virtualAddr / FOURMEG;
+    uint32_t * entries = (uint32_t *)PHYS_TO_VIRT(directory);
     // attributes: user level, read/write, present
-    pageDirectory[pde] = ((unsigned int)vidMemPageTable) | 7;
-    vidMemPageTable[0] = physicalAddr | 7; // attributes: user, read/write, present
-    flush_tlb();
+    entries[VIDMAP_START / FOURMEG] = ((unsigned int)vidMemPageTables[term]) | 7;
+    invalidatePage(VIDMAP_START);
 }
 
 /*
- *   Function: remapWithPageTableToPage
- *   description: This function takes virtutal and physical addresses (virtual must be a multiple of 4MB) and maps the 4MB chunk of memory (a single PDE)
- *                begining at the given virtual address to the specified page of the user page table
- *   inputs: virtualAddr - multiple of 4MB virtual address to be mapped
- *           physicalAddr - physical address to be mapped
- *           page - the page in the page table that we want to map to
+ *   Function: mapTimePage
+ *   description: Maps the kernel's time page, read only, at TIME_PAGE_START in the kernel's page directory.
+ *                The page is global, its mapping is the same in every process
+ *   inputs: physicalAddr - physical address of the time page
  *   outputs: none
+ *   effects: must run before the first process is created, processes copy the kernel's page directory
  *
  */
-void remapWithPageTableToPage(uint32_t virtualAddr, uint32_t physicalAddr, uint32_t page)
+void mapTimePage(uint32_t physicalAddr)
 {
-    uint32_t pde = virtualAddr / FOURMEG;
-    // attributes: user level, read/write, present
-    pageDirectory[pde] = ((unsigned int)userPageTable) | 7;
-    userPageTable[page] = physicalAddr | 7; // attributes: user, read/write, present
-    flush_tlb();
+    timePageTable[0] = physicalAddr | 0x105; // attributes: global, user, read only, present
+    // attributes: user level, read only, present
+    pageDirectory[TIME_PAGE_START / FOURMEG] = ((unsigned int)timePageTable) | 5;
 }
 
 
 /*
  *   Function: flush_tlb
- *   description: This reloads the tlb
+ *   description: This reloads the tlb (all but the global pages) of every processor. Prefer invalidatePage when
+ *                only a few mappings changed
  *   inputs: none
  *   outputs: none
  *
  */
 void flush_tlb(void){
+    tlb_flushes++;
 	asm volatile(
                  "mov %%cr3, %%eax;"
                  "mov %%eax, %%cr3;"
@@ -156,4 +159,206 @@ void flush_tlb(void){
                  :                      /* no inputs */
                  :"%eax"                /* clobbered register */
                  );
+    smp_flush_tlb_others();
+}
+
+/*
+ *   Function: mapMmio
+ *   description: Maps the 4MB region holding a device's registers (above the direct map) at the same virtual
+ *                address, uncached, in the kernel's page directory
+ *   inputs: physicalAddr - physical address of the registers
+ *   outputs: the virtual address of the registers
+ *   effects: must run before the first process is created, processes copy the kernel's page directory
+ *
+ */
+uint32_t mapMmio(uint32_t physicalAddr)
+{
+    uint32_t pde = physicalAddr / FOURMEG;
+    //attributes: global, size (4MB), cache disable, write through, supervisor, r/w, present
+    pageDirectory[pde] = (pde * FOURMEG) | 0x19B;
+    return physicalAddr;
+}
+
+/*
+ *   Function: invalidatePage
+ *   description: Drops the TLB entry of one page with invlpg, on every processor
+ *   inputs: virtualAddr - any address in the page whose mapping changed
+ *   outputs: none
+ *
+ */
+void invalidatePage(uint32_t virtualAddr)
+{
+    tlb_invlpgs++;
+    asm volatile("invlpg (%0)" : : "r"(virtualAddr) : "memory");
+    smp_flush_tlb_others();
+}
+
+/*
+ *   Function: sample_tlb_stats
+ *   description: Called once a second by the PIT handler, publishes the number of full TLB flushes (CR3 loads,
+ *                including context switches) and single page invalidations of the last second
+ *   inputs: none
+ *   outputs: none
+ *
+ */
+void sample_tlb_stats(void)
+{
+    tlb_flushes_per_sec = tlb_flushes;
+    tlb_invlpgs_per_sec = tlb_invlpgs;
+    tlb_flushes = 0;
+    tlb_invlpgs = 0;
+}
+
+/*
+ *   Function: print_tlb_stats
+ *   description: Prints the TLB counters of the last second (see sample_tlb_stats)
+ *   inputs: none
+ *   outputs: none
+ *
+ */
+void print_tlb_stats(void)
+{
+    printf("TLB: %u flushes/s, %u invlpg/s\n", tlb_flushes_per_sec, tlb_invlpgs_per_sec);
+}
+
+/*
+ *   Function: createUserPageTable
+ *   description: Allocates an empty page table for the 4MB user region of a new process
+ *   inputs: none
+ *   outputs: physical address of the page table, or 0 if memory is exhausted
+ *
+ */
+uint32_t createUserPageTable(void)
+{
+    uint32_t table = alloc_frame();
+    if (table != 0)
+        memset((void *)PHYS_TO_VIRT(table), 0, FOURKILO);
+    return table;
+}
+
+/*
+ *   Function: destroyUserPageTable
+ *   description: Frees every page a process faulted in, drops its references to shared page cache frames
+ *                and frees the page table itself. The table must not be reachable from the loaded page directory
+ *                anymore, so no TLB entry can point into it
+ *   inputs: table - physical address returned by createUserPageTable
+ *   outputs: none
+ *
+ */
+void destroyUserPageTable(uint32_t table)
+{
+    uint32_t * entries = (uint32_t *)PHYS_TO_VIRT(table);
+    uint32_t frame;
+    int i;
+    for (i = 0; i < ONEKILO; i++)
+    {
+        if (!(entries[i] & PAGE_PRESENT))
+            continue;
+        frame = entries[i] & ~(FOURKILO - 1);
+        if (entries[i] & PAGE_SHARED)
+            page_cache_put(frame);
+        else
+            free_frame(frame);
+    }
+    free_frame(table);
+}
+
+/*
+ *   Function: createPageDirectory
+ *   description: Allocates a page directory for a new process. It starts as a copy of the kernel's, so the
+ *                kernel mappings are shared, and the 4MB user region at 128MB uses the process's page table
+ *   inputs: table - physical address of the process's user page table
+ *   outputs: physical address of the page directory, or 0 if memory is exhausted
+ *
+ */
+uint32_t createPageDirectory(uint32_t table)
+{
+    uint32_t directory = alloc_frame();
+    uint32_t * entries;
+    if (directory == 0)
+        return 0;
+    entries = (uint32_t *)PHYS_TO_VIRT(directory);
+    memcpy(entries, pageDirectory, FOURKILO);
+    // attributes: user level, read/write, present
+    entries[_128MB / FOURMEG] = table | 7;
+    return directory;
+}
+
+/*
+ *   Function: destroyPageDirectory
+ *   description: Frees a page directory. It must not be loaded in CR3 anymore
+ *   inputs: directory - physical address returned by createPageDirectory
+ *   outputs: none
+ *
+ */
+void destroyPageDirectory(uint32_t directory)
+{
+    free_frame(directory);
+}
+
+/*
+ *   Function: loadPageDirectory
+ *   description: Switches address space by loading CR3. Global (kernel) pages stay in the TLB
+ *   inputs: directory - physical address of a page directory, pageDirectory for the kernel's
+ *   outputs: none
+ *
+ */
+void loadPageDirectory(uint32_t directory)
+{
+    tlb_flushes++;
+    asm volatile(
+                 "movl %0, %%cr3;"
+                 :                      /* no outputs */
+                 :"r"(directory)        /* input */
+                 :"memory"
+                 );
+}
+
+/*
+ *   Function: handle_page_fault
+ *   description: Called by the page fault wrapper in interrupts.S. A fault on a page of the user region that
+ *                is not present yet is a demand load, and the faulting instruction is retried afterwards. Read-only
+ *                program pages are mapped read-only to the shared copy in the page cache; all other pages get a
+ *                new frame filled from the executable (or zeroed for .bss and the stack).
+ *                Any other fault is fatal
+ *   inputs: fault_addr - the address that faulted (CR2)
+ *           error_code - the error code pushed by the processor
+ *   outputs: none
+ *
+ */
+void handle_page_fault(uint32_t fault_addr, uint32_t error_code)
+{
+    pcb_t * pcb;
+    uint32_t * entries;
+    uint32_t page;
+    uint32_t frame;
+    uint32_t flags;
+
+    if ((error_code & PAGE_PRESENT) || fault_addr < _128MB || fault_addr >= _132MB)
+        PAGE_FAULT_EXCEPTION();
+
+    cli_and_save(flags);
+    pcb = get_pcb_ptr();
+    page = fault_addr & ~(FOURKILO - 1);
+    entries = (uint32_t *)PHYS_TO_VIRT(pcb->page_table);
+
+    if (elf_page_read_only(&pcb->image, page) && (frame = page_cache_get(&pcb->image, page)) != 0)
+    {
+        // attributes: user, read only, present, shared
+        entries[(page - _128MB) / FOURKILO] = frame | PAGE_SHARED | PAGE_USER | PAGE_PRESENT;
+    }
+    else
+    {
+        // out of memory: nothing left to map the page to
+        if ((frame = alloc_frame()) == 0)
+            PAGE_FAULT_EXCEPTION();
+        // the executable could not be read: the page is never mapped
+        if (elf_load_page(&pcb->image, page, (uint8_t *)PHYS_TO_VIRT(frame)) != 0) {
+            free_frame(frame);
+            PAGE_FAULT_EXCEPTION();
+        }
+        // attributes: user, read/write, present
+        entries[(page - _128MB) / FOURKILO] = frame | 7;
+    }
+    restore_flags(flags);
 }
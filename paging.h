@@ -2,22 +2,51 @@
 *	paging.h - Function Header File to be used with paging.c
 */
 
+#ifndef _PAGING_H
+#define _PAGING_H
+
 #include "types.h"
 #define ONEKILO 1024
 #define FOURKILO 4096
 #define FOURMEG 0x400000
 
+/* Page table entry / page fault error code bits */
+#define PAGE_PRESENT 0x1
+#define PAGE_WRITE 0x2
+#define PAGE_USER 0x4
+#define PAGE_SIZE_4MB 0x80
+#define PAGE_SHARED 0x200 /* available bit: frame belongs to the page cache */
+
+/* Where vidmap maps a process's terminal video memory */
+#define VIDMAP_START _136MB
+
+/* Where every process sees the kernel's time page (time_page.h), read only */
+#define TIME_PAGE_START _140MB
+
 
 //data structures
 extern uint32_t pageDirectory[1024] __attribute__((aligned(4096)));
 extern uint32_t pageTable[1024] __attribute__((aligned(4096)));
+extern uint32_t tlb_flushes_per_sec;
+extern uint32_t tlb_invlpgs_per_sec;
 
 
 /* Function Definitions */
 void init_paging();
-void remap(uint32_t virtualAddr, uint32_t physicalAddr);
-void remapWithPageTable(uint32_t virtualAddr, uint32_t physicalAddr);
-void remapVideoWithPageTable(uint32_t virtualAddr, uint32_t physicalAddr);
-void remapWithPageTableToPage(uint32_t virtualAddr, uint32_t physicalAddr, uint32_t page);
+void mapTerminalVideo(uint32_t term, uint32_t physicalAddr);
+void mapVidmap(uint32_t directory, uint32_t term);
+void mapTimePage(uint32_t physicalAddr);
 void flush_tlb(void);
+uint32_t mapMmio(uint32_t physicalAddr);
+void invalidatePage(uint32_t virtualAddr);
+void sample_tlb_stats(void);
+void print_tlb_stats(void);
+uint32_t createUserPageTable(void);
+void destroyUserPageTable(uint32_t table);
+uint32_t createPageDirectory(uint32_t table);
+void destroyPageDirectory(uint32_t directory);
+void loadPageDirectory(uint32_t directory);
+void handle_page_fault(uint32_t fault_addr, uint32_t error_code);
+
+#endif /* _PAGING_H */
 
@@ -9,11 +9,15 @@
 #include "system_calls.h"
 #include "scheduling.h"
 #include "terminal.h"
+#include "wait_queue.h"
 
 
 /* To keep track of state of interrupt */
 volatile int rtc_interrupt_occurred [3] = { 0, 0, 0 };
 
+/* Tasks sleeping in rtc_read */
+static wait_queue_t rtc_wait_queue = WAIT_QUEUE_INIT;
+
 /*
 *   Function: init_rtc()
 *   Description: This function initializes the appropriate ports on the RTC,
@@ -58,12 +62,94 @@ void rtc_interrupt_handler(void){
 	{
 		rtc_interrupt_occurred[i] = 1; //change interrupt variable to show that it is occuring
 	}
+	wake_up_all(&rtc_wait_queue);
 	outb(0x0C, RTC_PORT); 	//select register C
 	inb(CMOS_PORT); 		//throw away contents
 	sti();
 }
 
 
+/* Days before each month in a year that is not a leap year */
+static const uint16_t days_before_month[12] = {
+	0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+};
+
+/* Reads one CMOS register */
+static uint8_t
+cmos_read(uint8_t reg){
+	outb(reg, RTC_PORT);
+	return inb(CMOS_PORT);
+}
+
+/* The clock registers, read while no update is in progress */
+static void
+cmos_read_clock(uint8_t clock[6]){
+	while (cmos_read(RTC_REGISTER_A) & RTC_UPDATE_IN_PROGRESS)
+		;
+	clock[0] = cmos_read(RTC_SECONDS);
+	clock[1] = cmos_read(RTC_MINUTES);
+	clock[2] = cmos_read(RTC_HOURS);
+	clock[3] = cmos_read(RTC_DAY);
+	clock[4] = cmos_read(RTC_MONTH);
+	clock[5] = cmos_read(RTC_YEAR);
+}
+
+/* BCD to binary */
+static uint32_t
+from_bcd(uint8_t value){
+	return (value >> 4) * 10 + (value & 0x0F);
+}
+
+/*
+*	Function: rtc_read_seconds()
+*	Description: Reads the wall clock from the CMOS clock registers, reading them until two reads in a
+*				 row agree so an update in between can not mix two times. The clock is taken to be UTC and
+*				 its two digit year to be in 2000-2099
+*	input:	none
+*	output: seconds since 1970-01-01 00:00:00
+*	effects: none
+*/
+uint32_t
+rtc_read_seconds(void){
+	uint8_t clock[6], again[6];
+	uint8_t format = cmos_read(RTC_REGISTER_B);
+	uint32_t second, minute, hour, day, month, year, days, y;
+	uint32_t pm;
+	int i;
+
+	cmos_read_clock(again);
+	do {
+		memcpy(clock, again, sizeof(clock));
+		cmos_read_clock(again);
+		for (i = 0; i < 6 && clock[i] == again[i]; i++)
+			;
+	} while (i < 6);
+
+	pm = clock[2] & RTC_PM;
+	clock[2] &= ~RTC_PM;
+	if (format & RTC_BINARY) {
+		second = clock[0]; minute = clock[1]; hour = clock[2];
+		day = clock[3]; month = clock[4]; year = clock[5];
+	} else {
+		second = from_bcd(clock[0]); minute = from_bcd(clock[1]); hour = from_bcd(clock[2]);
+		day = from_bcd(clock[3]); month = from_bcd(clock[4]); year = from_bcd(clock[5]);
+	}
+	/* 12 hour mode counts 12, 1, ..., 11 */
+	if (!(format & RTC_24_HOUR))
+		hour = hour % 12 + (pm ? 12 : 0);
+	if (month < 1 || month > 12)
+		month = 1;
+	year += 2000;
+
+	days = days_before_month[month - 1] + day - 1;
+	if (month > 2 && year % 4 == 0)
+		days++;
+	for (y = 1970; y < year; y++)
+		days += (y % 4 == 0) ? 366 : 365;
+	return ((days * 24 + hour) * 60 + minute) * 60 + second;
+}
+
+
 /*
 *	Function: rtc_open()
 *	Description: This will be our main funciton to open the RTC
@@ -92,13 +178,16 @@ rtc_open(const uint8_t * filename){
 int32_t 
 rtc_read(int32_t fd, void* buf, int32_t nbytes){
 
-	/* Disable interrupts and spin until interrupt received */
-	while (!rtc_interrupt_occurred[current_term_executing]){
-		/* SPIN */
-	}
+	uint8_t term_id = current_task->term->id;
+
+	/* Disable interrupts and sleep until interrupt received */
+	cli();
+	while (!rtc_interrupt_occurred[term_id])
+		sleep_on(&rtc_wait_queue);
 	
 	/* Reset interrupt-occured */
-	rtc_interrupt_occurred[current_term_executing] = 0;
+	rtc_interrupt_occurred[term_id] = 0;
+	sti();
 	/* Returns the number of bytes read always */
 	return 0;
  }
@@ -21,6 +21,19 @@
 #define	RTC_REGISTER_D	0x0D 
 
 
+/* Clock registers, and their format bits in Register B */
+#define RTC_SECONDS		0x00
+#define RTC_MINUTES		0x02
+#define RTC_HOURS		0x04
+#define RTC_DAY			0x07
+#define RTC_MONTH		0x08
+#define RTC_YEAR		0x09
+#define RTC_UPDATE_IN_PROGRESS	0x80	/* Register A */
+#define RTC_BINARY		0x04
+#define RTC_24_HOUR		0x02
+#define RTC_PM			0x80	/* in the hours register, 12 hour mode */
+
+
 /* PIC Interrupt Line */
 #define RTC_IRQ_LINE 8
 
@@ -43,6 +56,9 @@ void rtc_set_freq(int32_t freq);
 /* Close the RTC */
 int32_t rtc_close(int32_t fd);
 
+/* Wall clock time, in seconds since 1970 */
+uint32_t rtc_read_seconds(void);
+
 /* Test Interrupts used for Checkpoint 1 */
 void rtc_interrupt_handler(void);
 
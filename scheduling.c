@@ -1,5 +1,8 @@
 /*
-*   rtc.c - functions called to interact with the RTC (Real Time Clock)
+*   scheduling.c - the scheduler tick, the run queues and context switches. Every processor has its own
+*   run queues (in its cpu_t) and takes tasks from the busiest other processor when its own are empty.
+*   The tick comes from the PIT until init_lapic_tick calibrates the local APIC timers against it; from
+*   then on each processor's own timer is armed one tick at a time and the PIT is left off
 */
 
 #include "scheduling.h"
@@ -10,16 +13,54 @@
 #include "paging.h"
 #include "x86_desc.h"
 #include "terminal.h"
+#include "smp.h"
+#include "apic.h"
+#include "time_page.h"
 
 /*Global Variables to keep track of:*/
-/* Stores the current terminal that is executing the current process */
-volatile uint8_t current_term_executing = 0;
-uint8_t next_scheduled_term = 0;
+/* Ticks since boot (of the PIT, or the boot processor's local APIC timer), advanced by several at once
+ * after a tickless idle period */
+volatile uint32_t pit_ticks = 0;
+/* Tick rate and the matching channel 0 divisor, set by init_PIT and again once the local APIC timers
+ * take over. The rate and slice asked for are kept, the PIT may not be able to give them */
+uint32_t pit_hz = PIT_DEFAULT_HZ;
+static uint32_t pit_divisor = PIT_BASE_FREQ / PIT_DEFAULT_HZ;
+static uint32_t wanted_hz = PIT_DEFAULT_HZ;
+static uint32_t wanted_slice_ms = DEFAULT_SLICE_MS;
+/* Slice budget new tasks start with, in ticks */
+uint32_t default_slice_ticks = 1;
+/* Tick at which the per second counters are sampled next, the only timer deadline there is */
+static uint32_t next_sample_tick = PIT_DEFAULT_HZ;
+/* Ticks covered by the armed one-shot count and the count itself, 0 while the PIT is periodic */
+static uint32_t one_shot_ticks = 0;
+static uint32_t one_shot_count = 0;
+/* Set once the local APIC timers give the tick, and the time stamp counter cycles in a tick */
+static uint32_t lapic_tick = 0;
+uint32_t tsc_per_tick = 0;
+/* The boot processor's idle task has no process behind it, it is the boot thread */
+static pcb_t idle_pcb;
+
+/*
+*   Function: set_tick_rate()
+*   Description: Sets the tick rate, the once a second deadline and the slice of new tasks in ticks
+*   inputs: hz -- tick rate
+*   outputs: none
+*/
+static void
+set_tick_rate(uint32_t hz) {
+    pit_hz = hz;
+    next_sample_tick = pit_ticks + hz;
+    default_slice_ticks = wanted_slice_ms * hz / 1000;
+    if (default_slice_ticks == 0)
+        default_slice_ticks = 1;
+    idle_task->slice_ticks = default_slice_ticks;
+}
 
 /*
 *   Function: init_PIT()
 *   Description: This initializes the PIT to allow interrupts.
-*   inputs: none
+*   inputs: hz -- tick rate, clamped to what the PIT can do (init_lapic_tick can go faster, up to LAPIC_MAX_HZ)
+*           slice_ms -- time slice of new tasks in milliseconds, at least one tick
 *   outputs: none
 *   effects: effects IRQ Line 0 to allow interrupts from the PIT
 *   background:
@@ -27,18 +68,125 @@ uint8_t next_scheduled_term = 0;
 *       http://www.osdever.net/bkerndev/Docs/pit.htm
 */
 void 
-init_PIT(void) {
-    
-    /*Scheduler set to interrupt at 20 second intervals*/
-    outb(PIT_SQUARE_WAVE_MODE_3, PIT_COMMAND_REG);
-    outb(_20HZ & FREQ_MASK, PIT_CHANNEL_0);
-    outb(_20HZ >> _EIGHT, PIT_CHANNEL_0);
+init_PIT(uint32_t hz, uint32_t slice_ms) {
+    wanted_hz = (hz > LAPIC_MAX_HZ) ? LAPIC_MAX_HZ : hz;
+    wanted_slice_ms = slice_ms;
+    if (hz < PIT_MIN_HZ)
+        hz = PIT_MIN_HZ;
+    if (hz > PIT_MAX_HZ)
+        hz = PIT_MAX_HZ;
+    pit_divisor = PIT_BASE_FREQ / hz;
+    set_tick_rate(hz);
+    this_cpu()->last_charge_tsc = rdtsc();
+
+    /*Scheduler set to interrupt pit_hz times a second*/
+    pit_set_periodic();
     
     /*Enable IRQ Line 0 for PIT Interrupts*/
     enable_irq(PIT_IRQ_LINE);
     return;
 }
 
+/*
+*   Function: pit_set_periodic()
+*   Description: Programs channel 0 to interrupt every tick
+*   inputs: none
+*   outputs: none
+*/
+void
+pit_set_periodic(void) {
+    outb(PIT_SQUARE_WAVE_MODE_3, PIT_COMMAND_REG);
+    outb(pit_divisor & FREQ_MASK, PIT_CHANNEL_0);
+    outb(pit_divisor >> _EIGHT, PIT_CHANNEL_0);
+}
+
+/*
+*   Function: pit_enter_idle()
+*   Description: Stops the periodic tick while nothing is ready to run: channel 0 is armed to interrupt once,
+*                at the next timer deadline or as late as its 16 bit count allows
+*   inputs: none
+*   outputs: none
+*   effects: must be called with interrupts off
+*/
+void
+pit_enter_idle(void) {
+    uint32_t ticks = next_sample_tick > pit_ticks ? next_sample_tick - pit_ticks : 1;
+    if (ticks > PIT_MAX_COUNT / pit_divisor)
+        ticks = PIT_MAX_COUNT / pit_divisor;
+    one_shot_ticks = ticks;
+    one_shot_count = ticks * pit_divisor;
+    outb(PIT_ONE_SHOT_MODE_0, PIT_COMMAND_REG);
+    outb(one_shot_count & FREQ_MASK, PIT_CHANNEL_0);
+    outb(one_shot_count >> _EIGHT, PIT_CHANNEL_0);
+}
+
+/*
+*   Function: pit_exit_idle()
+*   Description: Goes back to the periodic tick when another interrupt ended the idle period early,
+*                crediting the whole ticks that went by (read back from the counter)
+*   inputs: none
+*   outputs: none
+*   effects: must be called with interrupts off
+*/
+void
+pit_exit_idle(void) {
+    uint32_t remaining;
+    if (one_shot_ticks == 0)
+        return;
+    outb(PIT_LATCH_CHANNEL_0, PIT_COMMAND_REG);
+    remaining = inb(PIT_CHANNEL_0);
+    remaining |= inb(PIT_CHANNEL_0) << _EIGHT;
+    /* Past the terminal count the counter wraps around, its interrupt is already pending */
+    if (remaining <= one_shot_count) {
+        pit_ticks += (one_shot_count - remaining) / pit_divisor;
+        idle_task->cpu_ticks += (one_shot_count - remaining) / pit_divisor;
+        time_page_tick(pit_ticks, rdtsc());
+    }
+    one_shot_ticks = 0;
+    pit_set_periodic();
+}
+
+/*
+*   Function: scheduler_tick()
+*   Description: Accounts ticks to the running task and switches tasks when its slice is used up. The boot
+*                processor also keeps the time since boot and the once a second work
+*   inputs: ticks -- ticks since the last call, more than one after a tickless idle period
+*   outputs: none
+*   effects: must be called with interrupts off
+*/
+static void
+scheduler_tick(uint32_t ticks) {
+    cpu_t * cpu = this_cpu();
+    pcb_t * task = cpu->current;
+
+    task->cpu_ticks += ticks;
+    if (cpu->id == 0) {
+        pit_ticks += ticks;
+        time_page_tick(pit_ticks, lapic_tick ? cpu->last_tick_tsc : rdtsc());
+        /* Once a second, publish the per second counters and lift every task back to the top level,
+         * so tasks stuck at the bottom can not starve */
+        if (pit_ticks >= next_sample_tick) {
+            next_sample_tick += pit_hz;
+            sample_tlb_stats();
+            boost_all_tasks();
+        }
+    }
+
+    /* A task that used up its whole slice drops a level. The idle task gives way as soon as anything
+     * is ready, other tasks when their slice is used up or a task of a higher level is ready */
+    if (task == cpu->idle) {
+        schedule();
+    } else if (task->slice_left <= ticks) {
+        set_task_level(task, task->level + 1);
+        task->slice_left = task->slice_ticks;
+        schedule();
+    } else {
+        task->slice_left -= ticks;
+        if (highest_ready_level() < task->level)
+            schedule();
+    }
+}
+
 /*
 *   Function: PIT_intterupt_and_schedule()
 *   Description: This is called whenever a PIT interrupt is received, and calls for a context switch
@@ -48,97 +196,501 @@ init_PIT(void) {
 */
 void
 PIT_interrupt_and_schedule() {
+    uint32_t ticks = 1;
     
     /*Last line - send EOI to PIT */
     send_eoi(PIT_IRQ_LINE); 
     
     cli();
-    if (terms[1].running == 1 || terms[2].running == 1) {
-            doContextSwitch(get_next_scheduled_process());
+    /* The one-shot of a tickless idle period ran out, count its ticks and tick periodically again */
+    if (one_shot_ticks != 0) {
+        ticks = one_shot_ticks;
+        one_shot_ticks = 0;
+        pit_set_periodic();
     }
+    scheduler_tick(ticks);
     sti();
     return;
 }
 
 /*
- *   Function: doContextSwitch(int processNumber);
- *   Description: Performs a context switch from the current process to another process
- *   inputs: process_number -- the number of the process to switch to
- *   outputs: none
- */
-void doContextSwitch(int process_number) {
-    /* Map a new page in virtual address 8MB to physical address 8 */
-    remap(_128MB, _8MB + process_number * _4MB);
+*   Function: lapic_tick_elapsed()
+*   Description: Counts the whole ticks of this processor's local APIC timer since the last one, on the
+*                time stamp counter, and moves the last tick forward by them
+*   inputs: cpu -- this processor
+*   outputs: the ticks, 0 if the timer went off a little early
+*/
+static uint32_t
+lapic_tick_elapsed(cpu_t * cpu) {
+    uint32_t ticks = div64_32(rdtsc() - cpu->last_tick_tsc, tsc_per_tick);
+    cpu->last_tick_tsc += (uint64_t)ticks * tsc_per_tick;
+    return ticks;
+}
 
-    /* Remap video memory to 136 MB */
-    uint8_t * screen_start;
-    vidmap(&screen_start);
+/*
+*   Function: lapic_tick_interrupt()
+*   Description: The local APIC timer interrupt: arms the timer for the next tick, one tick after the
+*                last (so ticks do not drift with interrupt latency), then does the tick
+*   inputs: none
+*   outputs: none
+*/
+void
+lapic_tick_interrupt(void) {
+    cpu_t * cpu = this_cpu();
+    uint32_t ticks;
 
+    lapic_eoi();
+    cli();
+    ticks = lapic_tick_elapsed(cpu);
+    lapic_timer_arm(cpu->last_tick_tsc + tsc_per_tick);
+    if (ticks != 0)
+        scheduler_tick(ticks);
+    sti();
+}
 
-    /* Get the PCB that we are changing FROM */
-    //pcb_t * old_pcb = get_pcb_ptr();
-    pcb_t * old_pcb = get_pcb_ptr_process(terms[current_term_executing].active_process_number);
-    current_term_executing = next_scheduled_term;
-    /* Get the PCB that we are switching INTO */
-    pcb_t * next_pcb = get_pcb_ptr_process(process_number);
-    
+/*
+*   Function: init_lapic_tick()
+*   Description: Measures the local APIC timer and the time stamp counter against a tenth of a second of
+*                PIT ticks, then moves the scheduler tick to the local APIC timers and turns the PIT off.
+*                The tick goes to the rate init_PIT was asked for even if the PIT could not give it, and
+*                the ticks since boot are converted to it.
+*                Called on the boot processor once its local APIC is enabled, with interrupts on
+*   inputs: none
+*   outputs: none
+*/
+void
+init_lapic_tick(void) {
+    uint32_t ticks = pit_hz / 10, start;
+    uint64_t tsc;
+
+    if (ticks == 0)
+        ticks = 1;
+    /* Start right on a tick */
+    start = pit_ticks;
+    while (pit_ticks == start)
+        cpu_relax();
+    lapic_timer_calibrate_start();
+    tsc = rdtsc();
+    start = pit_ticks;
+    while (pit_ticks - start < ticks)
+        cpu_relax();
+    tsc = rdtsc() - tsc;
+    lapic_timer_calibrate_end((uint32_t)tsc);
+    if (wanted_hz < PIT_MIN_HZ)
+        wanted_hz = PIT_MIN_HZ;
+    tsc_per_tick = div64_32(tsc * pit_hz, ticks * wanted_hz);
+
+    cli();
+    disable_irq(PIT_IRQ_LINE);
+    one_shot_ticks = 0;
+    pit_ticks = div64_32((uint64_t)pit_ticks * wanted_hz, pit_hz);
+    set_tick_rate(wanted_hz);
+    lapic_tick = 1;
+    init_cpu_tick();
+    sti();
+}
 
-    /* Get the terminal that we are switching INTO */
-    term_t * terminal = next_pcb->term;
+/*
+*   Function: init_cpu_tick()
+*   Description: Starts the calling processor's local APIC timer ticking, once init_lapic_tick has
+*                calibrated it
+*   inputs: none
+*   outputs: none
+*/
+void
+init_cpu_tick(void) {
+    cpu_t * cpu = this_cpu();
+    if (!lapic_tick)
+        return;
+    lapic_timer_setup();
+    cpu->last_tick_tsc = rdtsc();
+    lapic_timer_arm(cpu->last_tick_tsc + tsc_per_tick);
+}
 
-    /* If terminal is not being displayed, map virtual video mem to buffer */
-    if (terminal->id != current_term_id) {
-        remapVideoWithPageTable((uint32_t)screen_start, (uint32_t)terminal->video_mem);
+/*
+*   Function: tick_enter_idle() / tick_exit_idle()
+*   Description: Stop the periodic tick while a processor halts in its idle loop, and start it again with
+*                the ticks that went by credited. With the PIT only the boot processor ticks; with the
+*                local APIC timers the boot processor still wakes for the once a second work, the others
+*                only for interrupts
+*   inputs: cpu -- this processor
+*   outputs: none
+*   effects: must be called with interrupts off
+*/
+static void
+tick_enter_idle(cpu_t * cpu) {
+    if (!lapic_tick) {
+        if (cpu->id == 0 && one_shot_ticks == 0)
+            pit_enter_idle();
+    } else if (cpu->id == 0) {
+        lapic_timer_arm(cpu->last_tick_tsc + (uint64_t)tsc_per_tick *
+                        (next_sample_tick > pit_ticks ? next_sample_tick - pit_ticks : 1));
+    } else {
+        lapic_timer_stop();
     }
+}
 
-    /* Save SS0 and ESP0 in TSS for context switching */
-    tss.ss0 = KERNEL_DS;
-    //I THINK THIS SHOULD BE old_pcb->process_number because we are using the TSS to restore back??*/
-    tss.esp0 = _8MB - _8KB * (process_number) - 4;
-
-     /* FOR DEBUGGING */
-    //printf("Current Process Number: %d, Switching Into: %d\n", old_pcb->process_number, next_pcb->process_number);
-    //printf("-----------------------------------------\n");
-    /* Perform context switch, swap ESP/EBP with that of the registers */
-    asm volatile(
-                 "movl %%esp, %%eax;"
-                 "movl %%ebp, %%ebx;"
-                 :"=a"(old_pcb->esp), "=b"(old_pcb->ebp)    /* outputs */
-                 :                                          /* no input */
-                 );
-                 
-    asm volatile(
-                 "movl %%eax, %%esp;"
-                 "movl %%ebx, %%ebp;"
-                 :                                          /* no outputs */
-                 :"a"(next_pcb->esp), "b"(next_pcb->ebp)    /* input */
-                 );
-    return;
+static void
+tick_exit_idle(cpu_t * cpu) {
+    uint32_t ticks;
+    if (!lapic_tick) {
+        if (cpu->id == 0)
+            pit_exit_idle();
+        return;
+    }
+    ticks = lapic_tick_elapsed(cpu);
+    cpu->idle->cpu_ticks += ticks;
+    if (cpu->id == 0) {
+        pit_ticks += ticks;
+        time_page_tick(pit_ticks, cpu->last_tick_tsc);
+    }
+    lapic_timer_arm(cpu->last_tick_tsc + tsc_per_tick);
 }
 
 /*
- *   Function: get_next_scheduled_process()
- *   Description: calculates the process number of the next process to be executed
+ *   Function: init_idle_task
+ *   Description: Makes the boot thread the boot processor's idle task. init_terms saves its stack before
+ *                starting the first shell, so the first switch to it returns from init_terms into entry,
+ *                which then calls idle_loop
  *   inputs: none
- *   outputs: returns the process number of the next process to be executed
- *   effects: changes next_scheduled_term 
+ *   outputs: none
  */
-int 
-get_next_scheduled_process(){
-    /*Loop from 0 to 2 depending on the available processes/active processes at the time */
-    int i;
-	
-    next_scheduled_term = current_term_executing;
+void
+init_idle_task(void) {
+    init_cpu_idle_task(&cpus[0], &idle_pcb);
+}
 
-    for (i = 0; i < TERM_COUNT; i++)
-    {
-        next_scheduled_term = (next_scheduled_term + 1) % 3;
-        if (terms[next_scheduled_term].running == 1)
+/*
+ *   Function: init_cpu_idle_task
+ *   Description: Sets up a processor's idle task, which is also the task it runs at first. It uses the
+ *                kernel's page directory and belongs to no terminal
+ *   inputs: cpu -- the processor
+ *           idle -- its pcb, kernel_stack is the stack the processor starts on (the boot stack has none)
+ *   outputs: none
+ */
+void
+init_cpu_idle_task(cpu_t * cpu, pcb_t * idle) {
+    idle->process_number = NO_PROCESS;
+    idle->parent_process_number = NO_PROCESS;
+    idle->term = NULL;
+    idle->page_directory = (uint32_t)pageDirectory;
+    idle->state = TASK_RUNNING;
+    idle->run_next = NULL;
+    idle->level = MLFQ_LEVELS - 1;
+    idle->slice_ticks = idle->slice_left = default_slice_ticks;
+    idle->cpu_ticks = 0;
+    idle->cpu_cycles = 0;
+    idle->fpu_used = 0;
+    cpu->idle = idle;
+    cpu->current = idle;
+}
+
+/*
+ *   Function: idle_loop
+ *   Description: Runs whenever no task is ready. It halts the CPU until an interrupt makes a task ready
+ *                (or a timer deadline comes), then switches to that task. The periodic tick is stopped
+ *                while it halts. The kernel lock is dropped
+ *                while halted; the idle task holds it otherwise, also when switched back to
+ *   inputs: none
+ *   outputs: never returns
+ */
+void
+idle_loop(void) {
+    cpu_t * cpu = this_cpu();
+    pcb_t * next;
+    while (1) {
+        cli();
+        lock_kernel();
+        next = pick_next_task();
+        if (next != NULL) {
+            tick_exit_idle(cpu);
+            doContextSwitch(next);
+            continue;
+        }
+        tick_enter_idle(cpu);
+        unlock_kernel();
+        /* sti only takes effect after hlt, so an interrupt can not slip in between */
+        asm volatile("sti; hlt" : : : "memory");
+    }
+}
+
+/*
+ *   Function: set_task_level
+ *   Description: Moves a task (not a queued one) to a feedback level, clamped to the lowest. Lower levels
+ *                get longer slices: the default slice doubled for each level
+ *   inputs: task -- the task
+ *           level -- the new level, 0 is the highest priority
+ *   outputs: none
+ */
+void
+set_task_level(pcb_t * task, uint32_t level) {
+    if (level >= MLFQ_LEVELS)
+        level = MLFQ_LEVELS - 1;
+    task->level = level;
+    task->slice_ticks = default_slice_ticks << level;
+}
+
+/*
+ *   Function: task_ready
+ *   Description: Marks a task runnable and puts it at the back of this processor's run queue of its level,
+ *                then wakes an idle processor to take it if there is one. Idle tasks are never queued, they
+ *                run whenever every queue is empty
+ *   inputs: task -- a task that is not running and not already queued
+ *   outputs: none
+ *   effects: must be called with interrupts off
+ */
+void
+task_ready(pcb_t * task) {
+    cpu_t * cpu = this_cpu();
+    if (task == cpu->idle)
+        return;
+    task->state = TASK_READY;
+    task->run_next = NULL;
+    spin_lock(&cpu->lock);
+    if (cpu->run_queue_tail[task->level] != NULL)
+        cpu->run_queue_tail[task->level]->run_next = task;
+    else
+        cpu->run_queue_head[task->level] = task;
+    cpu->run_queue_tail[task->level] = task;
+    cpu->nr_ready++;
+    spin_unlock(&cpu->lock);
+    smp_kick_idle_cpu();
+}
+
+/*
+ *   Function: highest_ready_level
+ *   Description: Finds the highest priority level with a ready task in this processor's run queues, or in
+ *                any processor's when they are empty (pick_next_task would take one from there)
+ *   inputs: none
+ *   outputs: the level, or MLFQ_LEVELS if no task is ready
+ *   effects: must be called with interrupts off
+ */
+static uint32_t
+cpu_ready_level(cpu_t * cpu) {
+    uint32_t level;
+    for (level = 0; level < MLFQ_LEVELS; level++)
+        if (cpu->run_queue_head[level] != NULL)
             break;
+    return level;
+}
+
+uint32_t
+highest_ready_level(void) {
+    uint32_t level = cpu_ready_level(this_cpu());
+    uint32_t i;
+    if (level != MLFQ_LEVELS)
+        return level;
+    for (i = 0; i < cpu_count; i++)
+        if (cpus[i].nr_ready != 0)
+            return cpu_ready_level(&cpus[i]);
+    return MLFQ_LEVELS;
+}
+
+/*
+ *   Function: dequeue_task
+ *   Description: Takes the task at the front of the highest level run queue of a processor that has one
+ *   inputs: cpu -- the processor, its lock held
+ *   outputs: the task, or NULL if it has none ready
+ */
+static pcb_t *
+dequeue_task(cpu_t * cpu) {
+    uint32_t level = cpu_ready_level(cpu);
+    pcb_t * task;
+    if (level == MLFQ_LEVELS)
+        return NULL;
+    task = cpu->run_queue_head[level];
+    cpu->run_queue_head[level] = task->run_next;
+    if (cpu->run_queue_head[level] == NULL)
+        cpu->run_queue_tail[level] = NULL;
+    task->run_next = NULL;
+    cpu->nr_ready--;
+    return task;
+}
+
+/*
+ *   Function: steal_task
+ *   Description: Takes a task from the processor with the most ready tasks, for a processor whose own run
+ *                queues are empty. Only one run queue lock is held at a time
+ *   inputs: cpu -- the processor that steals
+ *   outputs: the task, or NULL if no processor has one ready
+ */
+static pcb_t *
+steal_task(cpu_t * cpu) {
+    cpu_t * busiest = NULL;
+    pcb_t * task;
+    uint32_t i;
+
+    for (i = 0; i < cpu_count; i++)
+        if (&cpus[i] != cpu && cpus[i].nr_ready != 0 && (busiest == NULL || cpus[i].nr_ready > busiest->nr_ready))
+            busiest = &cpus[i];
+    if (busiest == NULL)
+        return NULL;
+    spin_lock(&busiest->lock);
+    task = dequeue_task(busiest);
+    spin_unlock(&busiest->lock);
+    if (task != NULL)
+        cpu->steals++;
+    return task;
+}
+
+/*
+ *   Function: pick_next_task
+ *   Description: Takes the task at the front of the highest level run queue that has one, from this
+ *                processor's run queues or else from another processor's
+ *   inputs: none
+ *   outputs: the task, or NULL if no task is ready
+ *   effects: must be called with interrupts off
+ */
+pcb_t *
+pick_next_task(void) {
+    cpu_t * cpu = this_cpu();
+    pcb_t * task;
+    spin_lock(&cpu->lock);
+    task = dequeue_task(cpu);
+    spin_unlock(&cpu->lock);
+    if (task == NULL)
+        task = steal_task(cpu);
+    return task;
+}
+
+/*
+ *   Function: boost_task / boost_all_tasks
+ *   Description: Lift tasks back to the top level: a task woken from a wait queue (it gave up the CPU
+ *                waiting for input), and once a second every task so none starves
+ *   inputs: task -- a task that is not queued
+ *   outputs: none
+ *   effects: must be called with interrupts off
+ */
+void
+boost_task(pcb_t * task) {
+    if (task != this_cpu()->idle)
+        set_task_level(task, 0);
+}
+
+void
+boost_all_tasks(void) {
+    uint32_t level, i;
+    cpu_t * cpu;
+    pcb_t * task;
+
+    for (i = 0; i < process_table_size; i++)
+        if (pcbs[i] != NULL)
+            set_task_level(pcbs[i], 0);
+    /* Append the lower queues of every processor to its top one, keeping their order */
+    for (i = 0; i < cpu_count; i++) {
+        cpu = &cpus[i];
+        spin_lock(&cpu->lock);
+        for (level = 1; level < MLFQ_LEVELS; level++) {
+            if ((task = cpu->run_queue_head[level]) == NULL)
+                continue;
+            if (cpu->run_queue_tail[0] != NULL)
+                cpu->run_queue_tail[0]->run_next = task;
+            else
+                cpu->run_queue_head[0] = task;
+            cpu->run_queue_tail[0] = cpu->run_queue_tail[level];
+            cpu->run_queue_head[level] = NULL;
+            cpu->run_queue_tail[level] = NULL;
+        }
+        spin_unlock(&cpu->lock);
     }
+}
 
-    /* Return the proper "next process number" */
-    return (int)terms[next_scheduled_term].active_process_number;
-    
+/*
+ *   Function: schedule
+ *   Description: Switches from the running task to the front task of the highest ready level, unless the
+ *                running task's own level is higher. The running task goes to the back of its level's queue
+ *   inputs: none
+ *   outputs: none
+ *   effects: must be called with interrupts off
+ */
+void
+schedule(void) {
+    pcb_t * next;
+    uint32_t level = highest_ready_level();
+    if (current_task == NULL || level == MLFQ_LEVELS)
+        return;
+    if (current_task != idle_task && current_task->level < level)
+        return;
+    next = pick_next_task();
+    task_ready(current_task);
+    doContextSwitch(next);
 }
 
+/*
+ *   Function: doContextSwitch(pcb_t * next_pcb);
+ *   Description: Performs a context switch from the current task to another task
+ *   inputs: next_pcb -- the task to switch to, already taken off the run queue
+ *   outputs: none
+ *   effects: the old task may already be queued: the kernel lock keeps other processors from picking it
+ *            before switch_to has saved its stack
+ */
+void doContextSwitch(pcb_t * next_pcb) {
+    cpu_t * cpu = this_cpu();
+    /* Get the PCB that we are changing FROM */
+    pcb_t * old_pcb = cpu->current;
+    charge_cpu_time();
+    fpu_task_switch(old_pcb);
+    cpu->current = next_pcb;
+    cpu->dispatches++;
+    next_pcb->state = TASK_RUNNING;
+    next_pcb->slice_left = next_pcb->slice_ticks;
+    if (next_pcb != cpu->idle)
+        cpu->term_executing = next_pcb->term->id;
+
+    /* Switch address space. Its vidmap region already follows whether its terminal is displayed */
+    loadPageDirectory(next_pcb->page_directory);
+
+    /* Swap kernel stacks, pointing this processor's TSS at the new one. Idle tasks never enter user mode */
+    switch_to(&old_pcb->esp, next_pcb->esp, cpu->tss, next_pcb != cpu->idle ? KERNEL_STACK_TOP(next_pcb) : 0);
+}
+
+/*
+ *   Function: charge_cpu_time
+ *   Description: Adds the cycles since the last charge to the current task's CPU time. Called whenever
+ *                current_task is about to change
+ *   inputs: none
+ *   outputs: none
+ */
+void
+charge_cpu_time(void) {
+    cpu_t * cpu = this_cpu();
+    uint64_t now = rdtsc();
+    if (cpu->current != NULL)
+        cpu->current->cpu_cycles += now - cpu->last_charge_tsc;
+    cpu->last_charge_tsc = now;
+}
+
+/*
+ *   Function: print_task_stats
+ *   Description: Prints every task with its state, slice budget and the CPU time it used, counted in
+ *                ticks (as milliseconds) and in cycles
+ *   inputs: none
+ *   outputs: none
+ */
+void
+print_task_stats(void) {
+    static int8_t * state_names[] = { "run", "ready", "blocked", "dead" };
+    pcb_t * task;
+    uint32_t flags;
+    int i;
+
+    cli_and_save(flags);
+    charge_cpu_time();
+    printf("Tasks: %u Hz tick (%s), %u ticks since boot\n", pit_hz,
+           !lapic_tick ? "PIT" : lapic_timer_deadline_mode ? "local APIC, TSC deadline" : "local APIC, one-shot",
+           pit_ticks);
+    for (i = -(int)cpu_count; i < (int)process_table_size; i++) {
+        if (i < 0 && !cpus[cpu_count + i].online)
+            continue;
+        if (i >= 0 && pcbs[i] == NULL)
+            continue;
+        task = i < 0 ? cpus[cpu_count + i].idle : pcbs[i];
+        if (i < 0)
+            printf("  idle %d   ", cpu_count + i);
+        else
+            printf("  pid %d t%d ", task->process_number, task->term->id);
+        printf("%s L%u slice %u cpu %u ms %u Mcycles\n", state_names[task->state], task->level, task->slice_ticks,
+               task->cpu_ticks * 1000 / pit_hz, (uint32_t)(task->cpu_cycles >> 20));
+    }
+    restore_flags(flags);
+}
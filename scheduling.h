@@ -6,35 +6,87 @@
 
 #include "types.h"
 #include "system_calls.h"
+#include "x86_desc.h"
 
 /* */
 #define PIT_IRQ_LINE				0
 #define PIT_COMMAND_REG				0x43
 #define PIT_SQUARE_WAVE_MODE_3 		0x36
+#define PIT_ONE_SHOT_MODE_0 		0x30
+#define PIT_LATCH_CHANNEL_0 		0x00
 #define PIT_CHANNEL_0 				0x40
+#define PIT_MAX_COUNT 				0xFFFF
 
 
 /* Divisors for PIT Frequency setting 
- * HZ = 1193180 / HZ_VALUE (ex: HZ = 1193180 / 20);  
+ * DIVISOR = PIT_BASE_FREQ / HZ (ex: 11932 = 1193182 / 100);  
  */	
-#define _20HZ			11932
+#define PIT_BASE_FREQ	1193182
 #define FREQ_MASK 		0xFF
 #define _EIGHT			8
 
+/* Tick rate ("hz=" on the boot command line) and time slice ("slice=", in ms) */
+#define PIT_DEFAULT_HZ		100
+#define PIT_MIN_HZ			19		/* the divisor has to fit in 16 bits */
+#define PIT_MAX_HZ			1000
+#define LAPIC_MAX_HZ		10000	/* the local APIC timers are not limited to the PIT's rates */
+#define DEFAULT_SLICE_MS	10
 
-extern volatile uint8_t current_term_executing;
+/* Feedback levels of the run queue, level n gets (default slice << n) ticks */
+#define MLFQ_LEVELS			3
 
-/* Initialize RTC */
-void init_PIT(void);
+
+struct cpu;
+
+extern volatile uint32_t pit_ticks;
+extern uint32_t pit_hz;
+extern uint32_t default_slice_ticks;
+extern uint32_t tsc_per_tick;
+
+/* Initialize PIT */
+void init_PIT(uint32_t hz, uint32_t slice_ms);
+
+/* Periodic tick, and the one-shot used while idle */
+void pit_set_periodic(void);
+void pit_enter_idle(void);
+void pit_exit_idle(void);
 
 /* PIT Interruption */
 void PIT_interrupt_and_schedule(void);
 
+/* Local APIC timer tick: calibration against the PIT, each processor's start, and its interrupt */
+void init_lapic_tick(void);
+void init_cpu_tick(void);
+void lapic_tick_interrupt(void);
+
+/* Idle task: the boot thread (or an application processor's start up thread), it runs whenever the
+ * processor has no task ready */
+void init_idle_task(void);
+void init_cpu_idle_task(struct cpu * cpu, pcb_t * idle);
+void idle_loop(void);
+
+/* Run queue */
+void set_task_level(pcb_t * task, uint32_t level);
+void task_ready(pcb_t * task);
+uint32_t highest_ready_level(void);
+pcb_t * pick_next_task(void);
+void boost_task(pcb_t * task);
+void boost_all_tasks(void);
+void schedule(void);
+
+/* CPU time accounting */
+void charge_cpu_time(void);
+void print_task_stats(void);
+
 /*Context Switch */
-void doContextSwitch(int processNumber);
+void doContextSwitch(pcb_t * next_pcb);
+
+/* Kernel stack switching, switch.S */
+void switch_to(uint32_t* prev_esp, uint32_t next_esp, tss_t* tss, uint32_t next_esp0);
+int32_t switch_to_new_task(uint32_t* prev_esp, const uint8_t* command, term_t* term);
 
-/* Helper function to get next process to schedule */
-int get_next_scheduled_process();
 
+/* current_task, idle_task and current_term_executing are per processor */
+#include "smp.h"
 
 #endif
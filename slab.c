@@ -0,0 +1,287 @@
+/*
+*   slab.c - kernel heap. Each cache hands out fixed size objects from one page slabs taken
+*   from the frame allocator (through the direct map). kmalloc picks the smallest power of two
+*   cache that fits and gives larger requests whole frames. Every page starts with a slab_t
+*   header, so kfree finds its slab by masking the pointer.
+*/
+
+#include "slab.h"
+#include "frames.h"
+#include "lib.h"
+#include "types.h"
+
+/* Offset of the first object in a slab page */
+#define SLAB_OBJECTS_START	((sizeof(slab_t) + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1))
+
+/* Every cache, for the statistics */
+static kmem_cache_t* caches = NULL;
+
+/* Caches behind kmalloc, and the frames taken by larger requests */
+static kmem_cache_t kmalloc_caches[KMALLOC_CACHES];
+static const char* kmalloc_names[KMALLOC_CACHES] = {
+	"kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+	"kmalloc-256", "kmalloc-512", "kmalloc-1024", "kmalloc-2048"
+};
+static uint32_t large_pages = 0;
+
+/*
+*   Function: slab_list_add / slab_list_remove
+*   Description: push a slab on / unlink a slab from one of a cache's lists
+*   inputs: list -- head of the list
+*           slab -- the slab
+*/
+static void
+slab_list_add(slab_t** list, slab_t* slab)
+{
+	slab->prev = NULL;
+	slab->next = *list;
+	if (*list != NULL)
+		(*list)->prev = slab;
+	*list = slab;
+}
+
+static void
+slab_list_remove(slab_t** list, slab_t* slab)
+{
+	if (slab->prev != NULL)
+		slab->prev->next = slab->next;
+	else
+		*list = slab->next;
+	if (slab->next != NULL)
+		slab->next->prev = slab->prev;
+	slab->prev = NULL;
+	slab->next = NULL;
+}
+
+/*
+*   Function: new_slab
+*   Description: takes a frame for a cache and threads its objects on the free list
+*   inputs: cache -- the cache that ran out of objects
+*   outputs: the new slab (already on the partial list), or NULL if memory is exhausted
+*/
+static slab_t*
+new_slab(kmem_cache_t* cache)
+{
+	uint32_t frame = alloc_frame();
+	slab_t* slab;
+	uint8_t* object;
+	uint32_t i;
+
+	if (frame == 0)
+		return NULL;
+	slab = (slab_t*)PHYS_TO_VIRT(frame);
+	slab->magic = SLAB_MAGIC;
+	slab->cache = cache;
+	slab->in_use = 0;
+	slab->free = NULL;
+	/* Thread the free list backwards so objects are handed out in address order */
+	object = (uint8_t*)slab + SLAB_OBJECTS_START + (cache->objects_per_slab - 1) * cache->object_size;
+	for (i = 0; i < cache->objects_per_slab; i++, object -= cache->object_size) {
+		*(void**)object = slab->free;
+		slab->free = object;
+	}
+	slab_list_add(&cache->partial, slab);
+	cache->pages++;
+	return slab;
+}
+
+/*
+*   Function: init_slab
+*   Description: sets up the kmalloc caches. Needs the frame allocator and the direct map (init_paging)
+*   inputs: none
+*   outputs: none
+*/
+void
+init_slab(void)
+{
+	int i;
+	for (i = 0; i < KMALLOC_CACHES; i++)
+		kmem_cache_init(&kmalloc_caches[i], kmalloc_names[i], 1 << (KMALLOC_MIN_SHIFT + i));
+}
+
+/*
+*   Function: kmem_cache_init
+*   Description: sets up an empty cache and adds it to the statistics. No memory is taken until the
+*                first allocation
+*   inputs: cache -- the cache to set up
+*           name -- shown in the statistics
+*           size -- object size in bytes, at most a page minus the slab header
+*   outputs: none
+*/
+void
+kmem_cache_init(kmem_cache_t* cache, const char* name, uint32_t size)
+{
+	uint32_t flags;
+
+	if (size < sizeof(void*))
+		size = sizeof(void*);
+	cache->name = name;
+	cache->object_size = (size + SLAB_ALIGN - 1) & ~(SLAB_ALIGN - 1);
+	cache->objects_per_slab = (FRAME_SIZE - SLAB_OBJECTS_START) / cache->object_size;
+	cache->partial = NULL;
+	cache->full = NULL;
+	cache->hits = 0;
+	cache->misses = 0;
+	cache->pages = 0;
+
+	cli_and_save(flags);
+	cache->next = caches;
+	caches = cache;
+	restore_flags(flags);
+}
+
+/*
+*   Function: kmem_cache_alloc
+*   Description: allocates one object, from a partially used slab when there is one (a hit) or from a
+*                new page (a miss)
+*   inputs: cache -- the cache to allocate from
+*   outputs: the object, or NULL if memory is exhausted
+*/
+void*
+kmem_cache_alloc(kmem_cache_t* cache)
+{
+	uint32_t flags;
+	slab_t* slab;
+	void* object;
+
+	cli_and_save(flags);
+	slab = cache->partial;
+	if (slab != NULL) {
+		cache->hits++;
+	} else {
+		cache->misses++;
+		if ((slab = new_slab(cache)) == NULL) {
+			restore_flags(flags);
+			return NULL;
+		}
+	}
+
+	object = slab->free;
+	slab->free = *(void**)object;
+	slab->in_use++;
+	if (slab->free == NULL) {
+		slab_list_remove(&cache->partial, slab);
+		slab_list_add(&cache->full, slab);
+	}
+	restore_flags(flags);
+	return object;
+}
+
+/*
+*   Function: kmem_cache_free
+*   Description: gives an object back to its slab. A slab that becomes empty returns its page to the
+*                frame allocator, unless it is the only one the cache has with free objects
+*   inputs: cache -- the cache the object came from
+*           object -- the object
+*   outputs: none
+*/
+void
+kmem_cache_free(kmem_cache_t* cache, void* object)
+{
+	uint32_t flags;
+	slab_t* slab = (slab_t*)((uint32_t)object & ~(FRAME_SIZE - 1));
+
+	if (object == NULL || slab->magic != SLAB_MAGIC || slab->cache != cache)
+		return;
+
+	cli_and_save(flags);
+	if (slab->free == NULL) {
+		slab_list_remove(&cache->full, slab);
+		slab_list_add(&cache->partial, slab);
+	}
+	*(void**)object = slab->free;
+	slab->free = object;
+	slab->in_use--;
+
+	if (slab->in_use == 0 && (slab->prev != NULL || slab->next != NULL)) {
+		slab_list_remove(&cache->partial, slab);
+		slab->magic = 0;
+		free_frame(VIRT_TO_PHYS(slab));
+		cache->pages--;
+	}
+	restore_flags(flags);
+}
+
+/*
+*   Function: kmalloc
+*   Description: allocates size bytes from the smallest kmalloc cache that fits. Larger requests get a
+*                power of two run of frames with a header in front
+*   inputs: size -- bytes needed
+*   outputs: the memory, or NULL if size is 0 or memory is exhausted
+*/
+void*
+kmalloc(uint32_t size)
+{
+	uint32_t flags, count, frame;
+	slab_t* header;
+	int i;
+
+	if (size == 0)
+		return NULL;
+	if (size <= KMALLOC_MAX_SIZE) {
+		for (i = 0; (1 << (KMALLOC_MIN_SHIFT + i)) < size; i++)
+			;
+		return kmem_cache_alloc(&kmalloc_caches[i]);
+	}
+
+	for (count = 1; count * FRAME_SIZE < size + SLAB_OBJECTS_START; count <<= 1)
+		;
+	cli_and_save(flags);
+	frame = alloc_frames(count);
+	if (frame != 0)
+		large_pages += count;
+	restore_flags(flags);
+	if (frame == 0)
+		return NULL;
+
+	header = (slab_t*)PHYS_TO_VIRT(frame);
+	header->magic = LARGE_MAGIC;
+	header->cache = NULL;
+	header->in_use = count;
+	return (uint8_t*)header + SLAB_OBJECTS_START;
+}
+
+/*
+*   Function: kfree
+*   Description: frees memory returned by kmalloc
+*   inputs: ptr -- the memory, NULL is ignored
+*   outputs: none
+*/
+void
+kfree(void* ptr)
+{
+	uint32_t flags;
+	slab_t* slab = (slab_t*)((uint32_t)ptr & ~(FRAME_SIZE - 1));
+
+	if (ptr == NULL)
+		return;
+	if (slab->magic == SLAB_MAGIC) {
+		kmem_cache_free(slab->cache, ptr);
+	} else if (slab->magic == LARGE_MAGIC) {
+		cli_and_save(flags);
+		slab->magic = 0;
+		large_pages -= slab->in_use;
+		free_frames(VIRT_TO_PHYS(slab), slab->in_use);
+		restore_flags(flags);
+	}
+}
+
+/*
+*   Function: print_slab_stats
+*   Description: prints hits, misses and pages in use of every cache that has been used
+*   inputs: none
+*   outputs: none
+*/
+void
+print_slab_stats(void)
+{
+	kmem_cache_t* cache;
+
+	printf("Heap: %u free frames, %u pages in large kmallocs\n", free_frame_count(), large_pages);
+	for (cache = caches; cache != NULL; cache = cache->next) {
+		if (cache->hits == 0 && cache->misses == 0)
+			continue;
+		printf("  %s: %u hits, %u misses, %u pages\n",
+				cache->name, cache->hits, cache->misses, cache->pages);
+	}
+}
@@ -0,0 +1,79 @@
+/*
+*	slab.h - Function Header File to be used with "slab.c"
+*/
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include "types.h"
+
+/* Found at the start of every page handed out by the kernel heap */
+#define SLAB_MAGIC			0x51AB51AB
+#define LARGE_MAGIC			0x1A26E000
+
+/* kmalloc caches hold 16, 32, ... 2048 byte objects, larger requests get whole frames */
+#define KMALLOC_MIN_SHIFT	4
+#define KMALLOC_CACHES		8
+#define KMALLOC_MAX_SIZE	(1 << (KMALLOC_MIN_SHIFT + KMALLOC_CACHES - 1))
+
+/* Objects are aligned to this many bytes, enough for the FXSAVE area in a pcb */
+#define SLAB_ALIGN			16
+
+typedef struct slab slab_t;
+
+/*** Struct: kmem_cache_t
+*    name - shown in the statistics
+*    object_size - size of each object, rounded up to SLAB_ALIGN
+*    objects_per_slab - objects that fit in one page after the slab header
+*    partial - slabs with at least one free object
+*    full - slabs with every object in use
+*    hits - allocations served from a slab that was already there
+*    misses - allocations that had to take a new page
+*    pages - pages the cache currently holds
+*    next - next cache in the list of every cache
+***/
+typedef struct kmem_cache {
+	const char* name;
+	uint32_t object_size;
+	uint32_t objects_per_slab;
+	slab_t* partial;
+	slab_t* full;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t pages;
+	struct kmem_cache* next;
+} kmem_cache_t;
+
+/*** Struct: slab_t - header at the start of each slab page
+*    magic - SLAB_MAGIC, or LARGE_MAGIC for a kmalloc that took whole frames
+*    cache - cache the slab belongs to
+*    prev, next - neighbours in the cache's partial or full list
+*    free - first free object, each free object holds a pointer to the next one
+*    in_use - objects allocated from this slab (frame count for LARGE_MAGIC)
+***/
+struct slab {
+	uint32_t magic;
+	kmem_cache_t* cache;
+	slab_t* prev;
+	slab_t* next;
+	void* free;
+	uint32_t in_use;
+};
+
+/* Sets up the kmalloc caches, called once the frame allocator is ready */
+void init_slab(void);
+
+/* Sets up a cache of fixed size objects */
+void kmem_cache_init(kmem_cache_t* cache, const char* name, uint32_t size);
+
+/* Allocates / frees one object of a cache */
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* object);
+
+/* General purpose allocation, returns NULL when memory is exhausted */
+void* kmalloc(uint32_t size);
+void kfree(void* ptr);
+
+/* Prints hits, misses and pages of every cache */
+void print_slab_stats(void);
+
+#endif /* _SLAB_H */
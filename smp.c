@@ -0,0 +1,586 @@
+/*
+*   smp.c - multiprocessor support. The processors are found in the ACPI MADT (or the older
+*   MP table), each application processor is started with INIT and STARTUP interrupts and
+*   then runs its own idle loop, taking tasks from its run queue or another processor's.
+*   Only the run queues have their own locks (cpu_t.lock). The rest of the kernel still
+*   expects to run alone, so a processor holds the big kernel lock whenever it runs kernel
+*   code: user programs run in parallel, the kernel does not, and system call heavy
+*   workloads do not scale with the number of processors yet.
+*
+*   Still to do before the lock can go: the terminals and keyboard buffer, the frame
+*   allocator, the slab caches and the page cache, the process table with execute and halt,
+*   and the wait queues each need their own spinlock. The cli()/sti() pairs in those paths
+*   (halt, execute_in_term, terminal_read/terminal_write, rtc_read) then have to become
+*   lock/unlock pairs that also keep interrupts off on the local processor.
+*/
+
+#include "smp.h"
+#include "apic.h"
+#include "frames.h"
+#include "slab.h"
+#include "paging.h"
+#include "scheduling.h"
+#include "system_calls.h"
+#include "fpu.h"
+#include "lib.h"
+
+/* BIOS data area: segment of the extended BIOS data area, and KB of base memory */
+#define BDA_EBDA_SEGMENT	0x40E
+#define BDA_BASE_MEM_KB		0x413
+
+/* ACPI: root pointer, table header size, MADT fields and entry types */
+#define RSDP_RSDT_ADDR		16
+#define ACPI_HEADER_SIZE	36
+#define MADT_LAPIC_ADDR		36
+#define MADT_ENTRIES		44
+#define MADT_TYPE_LAPIC		0
+#define MADT_TYPE_IOAPIC	1
+#define MADT_TYPE_OVERRIDE	2
+#define MADT_LAPIC_ENABLED	0x1
+#define MADT_BUS_ISA		0
+
+/* MP specification: floating pointer and configuration table fields, entry types and sizes */
+#define MPF_CONFIG_ADDR		4
+#define MPC_ENTRY_COUNT		34
+#define MPC_LAPIC_ADDR		36
+#define MPC_ENTRIES			44
+#define MPC_TYPE_PROCESSOR	0
+#define MPC_TYPE_BUS		1
+#define MPC_TYPE_IOAPIC		2
+#define MPC_TYPE_IO_INT		3
+#define MPC_PROCESSOR_SIZE	20
+#define MPC_OTHER_SIZE		8
+#define MPC_CPU_ENABLED		0x1
+#define MPC_IOAPIC_ENABLED	0x1
+#define MPC_INT_VECTORED	0
+
+/* CPUID leaf 1 EDX: the processor has a local APIC */
+#define CPUID_APIC			0x00000200
+
+/* How long to wait around the startup interrupts, in milliseconds */
+#define INIT_DELAY_MS		10
+#define STARTUP_DELAY_MS	1
+#define AP_ONLINE_MS		100
+
+cpu_t cpus[MAX_CPUS];
+uint32_t cpu_count = 1;
+volatile uint32_t cpus_online = 1;
+
+/* The big kernel lock, and the processor holding it (-1 when free) */
+static spinlock_t kernel_lock = SPINLOCK_INIT;
+static volatile int32_t kernel_lock_cpu = -1;
+
+/* TLB shootdowns sent */
+static uint32_t tlb_shootdowns = 0;
+
+/* Start up code (ap_boot.S), and what it hands ap_main */
+extern uint8_t ap_trampoline_start[], ap_trampoline_end[], ap_trampoline_gdt[];
+extern uint8_t gdt_desc_ptr[];
+extern uint32_t ap_boot_stack, ap_boot_cpu;
+
+/*
+*   Function: checksum
+*   Description: adds up the bytes of a firmware table, valid tables add up to 0
+*   inputs: table -- start of the table
+*           length -- its length in bytes
+*   outputs: the sum (mod 256)
+*/
+static uint8_t
+checksum(const uint8_t* table, uint32_t length)
+{
+	uint8_t sum = 0;
+	while (length-- > 0)
+		sum += *table++;
+	return sum;
+}
+
+/*
+*   Function: phys_table
+*   Description: gives the kernel address of a firmware table if the direct map covers it
+*   inputs: phys -- physical address of the table
+*           length -- bytes that have to be mapped
+*   outputs: the address, or NULL
+*/
+static uint8_t*
+phys_table(uint32_t phys, uint32_t length)
+{
+	uint32_t top = (phys_mem_top() + FOURMEG - 1) & ~(FOURMEG - 1);
+	if (phys == 0 || phys >= top || length > top - phys)
+		return NULL;
+	return (uint8_t*)PHYS_TO_VIRT(phys);
+}
+
+/*
+*   Function: scan_for
+*   Description: looks for a signature on a 16 byte boundary in a physical range, as the BIOS leaves
+*                its root pointers
+*   inputs: start, length -- the range
+*           signature -- the bytes to look for
+*           size -- bytes that have to add up to 0 behind the signature
+*   outputs: the kernel address of the structure, or NULL
+*/
+static uint8_t*
+scan_for(uint32_t start, uint32_t length, const int8_t* signature, uint32_t size)
+{
+	uint8_t* p = phys_table(start, length);
+	uint8_t* end = p + length;
+	uint32_t sig_len = strlen(signature);
+
+	if (p == NULL)
+		return NULL;
+	for (; p + size <= end; p += 16)
+		if (strncmp((int8_t*)p, signature, sig_len) == 0 && checksum(p, size) == 0)
+			return p;
+	return NULL;
+}
+
+/*
+*   Function: find_root
+*   Description: looks for a root pointer where the specifications put it: the first KB of the extended
+*                BIOS data area, the last KB of base memory, then the BIOS ROM
+*   inputs: signature -- "RSD PTR " or "_MP_"
+*           size -- bytes covered by its checksum
+*           rom_start -- start of the ROM area to search (it ends at 1MB)
+*   outputs: the kernel address of the root pointer, or NULL
+*/
+static uint8_t*
+find_root(const int8_t* signature, uint32_t size, uint32_t rom_start)
+{
+	uint32_t ebda = *(uint16_t*)PHYS_TO_VIRT(BDA_EBDA_SEGMENT) << 4;
+	uint32_t base_top = *(uint16_t*)PHYS_TO_VIRT(BDA_BASE_MEM_KB) * 1024;
+	uint8_t* root = NULL;
+
+	if (ebda != 0)
+		root = scan_for(ebda, 1024, signature, size);
+	if (root == NULL && base_top >= 1024)
+		root = scan_for(base_top - 1024, 1024, signature, size);
+	if (root == NULL)
+		root = scan_for(rom_start, _1MB - rom_start, signature, size);
+	return root;
+}
+
+/*
+*   Function: add_cpu
+*   Description: records an application processor from the tables, the boot processor is already cpus[0]
+*   inputs: apic_id -- id of its local APIC
+*   outputs: none
+*/
+static void
+add_cpu(uint32_t apic_id)
+{
+	if (apic_id == cpus[0].apic_id || cpu_count == MAX_CPUS)
+		return;
+	cpus[cpu_count].id = cpu_count;
+	cpus[cpu_count].apic_id = apic_id;
+	cpu_count++;
+}
+
+/*
+*   Function: parse_madt
+*   Description: finds the local APIC address and the enabled processors in the ACPI MADT
+*   inputs: none
+*   outputs: the physical address of the local APIC registers, 0 if there is no MADT
+*/
+static uint32_t
+parse_madt(void)
+{
+	uint8_t* rsdp = find_root("RSD PTR ", 20, 0xE0000);
+	uint8_t *rsdt, *madt = NULL, *entry, *end;
+	uint32_t i, entries;
+
+	if (rsdp == NULL || (rsdt = phys_table(*(uint32_t*)(rsdp + RSDP_RSDT_ADDR), ACPI_HEADER_SIZE)) == NULL)
+		return 0;
+	if (phys_table(VIRT_TO_PHYS(rsdt), *(uint32_t*)(rsdt + 4)) == NULL)
+		return 0;
+
+	entries = (*(uint32_t*)(rsdt + 4) - ACPI_HEADER_SIZE) / 4;
+	for (i = 0; i < entries && madt == NULL; i++) {
+		uint8_t* table = phys_table(((uint32_t*)(rsdt + ACPI_HEADER_SIZE))[i], ACPI_HEADER_SIZE);
+		if (table != NULL && strncmp((int8_t*)table, "APIC", 4) == 0
+				&& phys_table(VIRT_TO_PHYS(table), *(uint32_t*)(table + 4)) != NULL)
+			madt = table;
+	}
+	if (madt == NULL)
+		return 0;
+
+	end = madt + *(uint32_t*)(madt + 4);
+	for (entry = madt + MADT_ENTRIES; entry + 2 <= end && entry[1] >= 2; entry += entry[1]) {
+		if (entry[0] == MADT_TYPE_LAPIC && (entry[4] & MADT_LAPIC_ENABLED))
+			add_cpu(entry[3]);
+		else if (entry[0] == MADT_TYPE_IOAPIC)
+			ioapic_add(entry[2], *(uint32_t*)(entry + 4), *(uint32_t*)(entry + 8));
+		else if (entry[0] == MADT_TYPE_OVERRIDE && entry[2] == MADT_BUS_ISA)
+			ioapic_set_override(entry[3], *(uint32_t*)(entry + 4), *(uint16_t*)(entry + 8));
+	}
+	return *(uint32_t*)(madt + MADT_LAPIC_ADDR);
+}
+
+/*
+*   Function: parse_mp_table
+*   Description: finds the local APIC address and the enabled processors in the MP configuration table,
+*                for firmware without ACPI
+*   inputs: none
+*   outputs: the physical address of the local APIC registers, 0 if there is no MP table
+*/
+static uint32_t
+parse_mp_table(void)
+{
+	uint8_t* mpf = find_root("_MP_", 16, 0xF0000);
+	uint8_t *mpc, *entry;
+	uint32_t i, count, gsi;
+	int32_t isa_bus = -1;
+
+	if (mpf == NULL || (mpc = phys_table(*(uint32_t*)(mpf + MPF_CONFIG_ADDR), MPC_ENTRIES)) == NULL)
+		return 0;
+	if (strncmp((int8_t*)mpc, "PCMP", 4) != 0)
+		return 0;
+
+	count = *(uint16_t*)(mpc + MPC_ENTRY_COUNT);
+	entry = mpc + MPC_ENTRIES;
+	for (i = 0; i < count; i++) {
+		if (entry[0] == MPC_TYPE_PROCESSOR) {
+			if (entry[3] & MPC_CPU_ENABLED)
+				add_cpu(entry[1]);
+			entry += MPC_PROCESSOR_SIZE;
+			continue;
+		}
+		/* Bus entries come before the interrupt entries that name them */
+		if (entry[0] == MPC_TYPE_BUS && strncmp((int8_t*)entry + 2, "ISA", 3) == 0) {
+			isa_bus = entry[1];
+		} else if (entry[0] == MPC_TYPE_IOAPIC && (entry[3] & MPC_IOAPIC_ENABLED)) {
+			ioapic_add(entry[1], *(uint32_t*)(entry + 4), IOAPIC_NEXT_GSI);
+		} else if (entry[0] == MPC_TYPE_IO_INT && entry[1] == MPC_INT_VECTORED && entry[4] == isa_bus) {
+			gsi = ioapic_pin_gsi(entry[6], entry[7]);
+			if (gsi != IOAPIC_NEXT_GSI)
+				ioapic_set_override(entry[5], gsi, *(uint16_t*)(entry + 2));
+		}
+		entry += MPC_OTHER_SIZE;
+	}
+	return *(uint32_t*)(mpc + MPC_LAPIC_ADDR);
+}
+
+/*
+*   Function: delay_ms
+*   Description: busy waits on the PIT tick count, at least ms milliseconds
+*   inputs: ms -- milliseconds
+*   outputs: none
+*   effects: interrupts must be on
+*/
+static void
+delay_ms(uint32_t ms)
+{
+	uint32_t start = pit_ticks;
+	uint32_t ticks = ms * pit_hz / 1000 + 1;
+	while (pit_ticks - start < ticks)
+		cpu_relax();
+}
+
+/*
+*   Function: boot_ap
+*   Description: gives an application processor a task state segment (from kmalloc, the boot processor
+*                uses tss) and an idle task (a pcb with a new kernel stack), then starts it with the
+*                INIT, STARTUP, STARTUP sequence
+*   inputs: cpu -- the processor
+*   outputs: none, cpu->online tells whether it came up
+*/
+static void
+boot_ap(cpu_t* cpu)
+{
+	uint32_t stack = alloc_frames(_8KB / FRAME_SIZE);
+	tss_t* ap;
+	seg_desc_t the_tss_desc;
+	pcb_t* idle;
+	uint32_t waited;
+
+	if (stack == 0)
+		return;
+	ap = kmalloc(sizeof(tss_t));
+	idle = kmem_cache_alloc(&pcb_cache);
+	if (ap == NULL || idle == NULL) {
+		kfree(ap);
+		if (idle != NULL)
+			kmem_cache_free(&pcb_cache, idle);
+		free_frames(stack, _8KB / FRAME_SIZE);
+		return;
+	}
+	memset(ap, 0, sizeof(tss_t));
+	idle->kernel_stack = PHYS_TO_VIRT(stack);
+	init_cpu_idle_task(cpu, idle);
+
+	the_tss_desc.granularity    = 0;
+	the_tss_desc.opsize         = 0;
+	the_tss_desc.reserved       = 0;
+	the_tss_desc.avail          = 0;
+	the_tss_desc.seg_lim_19_16  = TSS_SIZE & 0x000F0000;
+	the_tss_desc.present        = 1;
+	the_tss_desc.dpl            = 0x0;
+	the_tss_desc.sys            = 0;
+	the_tss_desc.type           = 0x9;
+	the_tss_desc.seg_lim_15_00  = TSS_SIZE & 0x0000FFFF;
+	SET_TSS_PARAMS(the_tss_desc, ap, tss_size);
+	ap_tss_desc_ptr[cpu->id - 1] = the_tss_desc;
+
+	ap->ldt_segment_selector = KERNEL_LDT;
+	ap->ss0 = KERNEL_DS;
+	ap->esp0 = KERNEL_STACK_TOP(idle);
+	cpu->tss = ap;
+	cpu->tss_selector = AP_TSS_BASE + (cpu->id - 1) * sizeof(seg_desc_t);
+
+	ap_boot_stack = KERNEL_STACK_TOP(idle);
+	ap_boot_cpu = cpu->id;
+
+	lapic_send_init(cpu->apic_id);
+	delay_ms(INIT_DELAY_MS);
+	lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE >> 12);
+	delay_ms(STARTUP_DELAY_MS);
+	if (!cpu->online)
+		lapic_send_startup(cpu->apic_id, AP_TRAMPOLINE >> 12);
+	for (waited = 0; !cpu->online && waited < AP_ONLINE_MS; waited++)
+		delay_ms(1);
+	if (cpu->online)
+		cpus_online++;
+	else
+		printf("cpu %d (apic %d) did not start\n", cpu->id, cpu->apic_id);
+}
+
+/*
+*   Function: init_smp
+*   Description: finds the processors, turns on the boot processor's local APIC and starts the others.
+*                Without MP or ACPI tables the kernel stays on the boot processor
+*   inputs: none
+*   outputs: none
+*   effects: needs the frame allocator, paging, the idle task and the PIT (for delays, with interrupts
+*            on), and the big kernel lock held: the new processors wait for it in their idle loops
+*/
+void
+init_smp(void)
+{
+	uint32_t lapic_phys, i, eax, ebx, ecx, edx;
+
+	cpus[0].tss = &tss;
+	cpus[0].tss_selector = KERNEL_TSS;
+	cpus[0].online = 1;
+
+	eax = 1;
+	asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	if (!(edx & CPUID_APIC)) {
+		printf("No local APIC, 1 processor\n");
+		return;
+	}
+
+	/* The boot processor's APIC id is only known once its registers are mapped, read it first */
+	lapic_map(LAPIC_DEFAULT_BASE);
+	cpus[0].apic_id = lapic_id();
+	lapic_phys = parse_madt();
+	if (lapic_phys == 0)
+		lapic_phys = parse_mp_table();
+	if (lapic_phys == 0) {
+		printf("No MP or ACPI tables, 1 processor\n");
+		return;
+	}
+	if (lapic_phys != LAPIC_DEFAULT_BASE) {
+		lapic_map(lapic_phys);
+		cpus[0].apic_id = lapic_id();
+	}
+	lapic_enable();
+
+	/* The ISA IRQs go to the boot processor through the I/O APIC if there is one, else the 8259s stay */
+	ioapic_init(cpus[0].apic_id);
+
+	/* Each processor's own timer gives the scheduler tick from here on */
+	init_lapic_tick();
+
+	memcpy((void*)PHYS_TO_VIRT(AP_TRAMPOLINE), ap_trampoline_start, ap_trampoline_end - ap_trampoline_start);
+	memcpy((void*)PHYS_TO_VIRT(AP_TRAMPOLINE + (ap_trampoline_gdt - ap_trampoline_start)), gdt_desc_ptr, 6);
+	for (i = 1; i < cpu_count; i++)
+		boot_ap(&cpus[i]);
+	printf("%u of %u processors online\n", cpus_online, cpu_count);
+}
+
+/*
+*   Function: ap_main
+*   Description: an application processor's first C code (from ap_boot.S) on its idle task's stack. It
+*                loads its task register and the IDT, turns on its local APIC and FPU, then idles
+*   inputs: id -- its index in cpus[]
+*   outputs: never returns
+*/
+void
+ap_main(uint32_t id)
+{
+	cpu_t* cpu = &cpus[id];
+
+	ltr(cpu->tss_selector);
+	lldt(KERNEL_LDT);
+	lidt(idt_desc_ptr);
+	lapic_enable();
+	init_fpu();
+	init_cpu_tick();
+	init_sysenter();
+	cpu->last_charge_tsc = rdtsc();
+	cpu->online = 1;
+	idle_loop();
+}
+
+/*
+*   Function: reload_cr3
+*   Description: drops the calling processor's non-global TLB entries, for a TLB shootdown
+*   inputs: none
+*   outputs: none
+*/
+static inline void
+reload_cr3(void)
+{
+	asm volatile("movl %%cr3, %%eax; movl %%eax, %%cr3" : : : "eax", "memory");
+}
+
+/*
+*   Function: lock_kernel
+*   Description: takes the big kernel lock for the calling processor, unless it holds it already (kernel
+*                code interrupted by an interrupt). While spinning it still answers TLB shootdowns, as the
+*                holder may be waiting for one
+*   inputs: none
+*   outputs: 1 if it took the lock (the caller releases it on the way out), 0 if it was held already
+*/
+int32_t
+lock_kernel(void)
+{
+	uint32_t flags;
+	cpu_t* cpu;
+
+	cli_and_save(flags);
+	cpu = this_cpu();
+	if (kernel_lock_cpu == (int32_t)cpu->id) {
+		restore_flags(flags);
+		return 0;
+	}
+	while (!spin_trylock(&kernel_lock)) {
+		while (kernel_lock.locked) {
+			if (cpu->tlb_flush_pending) {
+				reload_cr3();
+				cpu->tlb_flush_pending = 0;
+			}
+			cpu_relax();
+		}
+	}
+	kernel_lock_cpu = cpu->id;
+	restore_flags(flags);
+	return 1;
+}
+
+/*
+*   Function: unlock_kernel
+*   Description: releases the big kernel lock, when the calling processor leaves the kernel (or halts)
+*   inputs: none
+*   outputs: none
+*   effects: must be called with interrupts off
+*/
+void
+unlock_kernel(void)
+{
+	kernel_lock_cpu = -1;
+	spin_unlock(&kernel_lock);
+}
+
+/*
+*   Function: smp_flush_tlb_others
+*   Description: TLB shootdown: after shared mappings changed, makes every other processor flush its TLB
+*                and waits until they all did
+*   inputs: none
+*   outputs: none
+*   effects: the caller holds the big kernel lock
+*/
+void
+smp_flush_tlb_others(void)
+{
+	cpu_t* self;
+	uint32_t i;
+
+	if (cpus_online <= 1)
+		return;
+	self = this_cpu();
+	for (i = 0; i < cpu_count; i++) {
+		if (&cpus[i] == self || !cpus[i].online)
+			continue;
+		cpus[i].tlb_flush_pending = 1;
+		lapic_send_ipi(cpus[i].apic_id, TLB_FLUSH_VECTOR);
+	}
+	for (i = 0; i < cpu_count; i++)
+		while (cpus[i].tlb_flush_pending)
+			cpu_relax();
+	tlb_shootdowns++;
+}
+
+/*
+*   Function: smp_kick_idle_cpu
+*   Description: sends a reschedule interrupt to one other processor that is running its idle task, which
+*                wakes it from hlt to look for work
+*   inputs: none
+*   outputs: none
+*/
+void
+smp_kick_idle_cpu(void)
+{
+	cpu_t* self;
+	uint32_t i;
+
+	if (cpus_online <= 1)
+		return;
+	self = this_cpu();
+	for (i = 0; i < cpu_count; i++) {
+		if (&cpus[i] != self && cpus[i].online && cpus[i].current == cpus[i].idle) {
+			lapic_send_ipi(cpus[i].apic_id, RESCHEDULE_VECTOR);
+			return;
+		}
+	}
+}
+
+/*
+*   Function: tlb_flush_interrupt / reschedule_interrupt
+*   Description: handlers of the inter-processor interrupts. They do not take the big kernel lock, the
+*                sender may hold it. A reschedule only has to wake the processor, its idle loop does the rest
+*   inputs: none
+*   outputs: none
+*/
+void
+tlb_flush_interrupt(void)
+{
+	cpu_t* cpu = this_cpu();
+	if (cpu->tlb_flush_pending) {
+		reload_cr3();
+		cpu->tlb_flush_pending = 0;
+	}
+	lapic_eoi();
+}
+
+void
+reschedule_interrupt(void)
+{
+	lapic_eoi();
+}
+
+/*
+*   Function: print_smp_stats
+*   Description: prints each processor with what it is running and how often it switched and stole tasks,
+*                and how system calls get into the kernel
+*   inputs: none
+*   outputs: none
+*/
+void
+print_smp_stats(void)
+{
+	uint32_t i;
+
+	printf("CPUs: %u online of %u, %u TLB shootdowns, IRQs through the %s\n", cpus_online, cpu_count, tlb_shootdowns,
+			ioapic_enabled ? "I/O APIC" : "8259s");
+	printf("System calls through %s\n", sysenter_enabled ? "int 0x80 and sysenter" : "int 0x80");
+	for (i = 0; i < cpu_count; i++) {
+		if (!cpus[i].online)
+			continue;
+		printf("  cpu %u apic %u: ", i, cpus[i].apic_id);
+		if (cpus[i].current == cpus[i].idle)
+			printf("idle");
+		else
+			printf("pid %d", cpus[i].current->process_number);
+		printf(", %u ready, %u dispatches, %u steals\n", cpus[i].nr_ready, cpus[i].dispatches, cpus[i].steals);
+	}
+}
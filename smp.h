@@ -0,0 +1,106 @@
+/*
+*	smp.h - Function Header File to be used with "smp.c"
+*/
+#ifndef _SMP_H
+#define _SMP_H
+
+/* Physical address the application processors start at, in real mode (below 1MB, 4KB aligned) */
+#define AP_TRAMPOLINE		0x8000
+
+#ifndef ASM
+
+#include "types.h"
+#include "x86_desc.h"
+#include "spinlock.h"
+#include "scheduling.h"
+
+/*** Struct: cpu_t - what each processor keeps for itself, found with this_cpu()
+*    id - index in cpus[], 0 is the boot processor
+*    apic_id - id of its local APIC
+*    online - set once it runs the kernel
+*    tss, tss_selector - its task state segment and the GDT selector of it
+*    current - the task on it, idle - its idle task
+*    lock - protects the run queues
+*    run_queue_head, run_queue_tail - its TASK_READY tasks for each feedback level, nr_ready - how many
+*    term_executing - terminal of the current task, where printing goes
+*    last_charge_tsc - time stamp counter when CPU time was last charged to the current task
+*    last_tick_tsc - time stamp counter of the last tick of its local APIC timer
+*    dead_task - the last task that halted on it, its pcb and kernel stack are freed by the next halt
+*    fpu_owner - task whose registers its FPU holds
+*    tlb_flush_pending - shared mappings changed, it has to flush its TLB
+*    dispatches - switches to another task, steals - tasks it took from another processor's run queue
+***/
+typedef struct cpu {
+	uint32_t id;
+	uint32_t apic_id;
+	volatile uint32_t online;
+	tss_t * tss;
+	uint16_t tss_selector;
+	pcb_t * current;
+	pcb_t * idle;
+	spinlock_t lock;
+	pcb_t * run_queue_head[MLFQ_LEVELS];
+	pcb_t * run_queue_tail[MLFQ_LEVELS];
+	uint32_t nr_ready;
+	volatile uint8_t term_executing;
+	uint64_t last_charge_tsc;
+	uint64_t last_tick_tsc;
+	pcb_t * dead_task;
+	pcb_t * fpu_owner;
+	volatile uint32_t tlb_flush_pending;
+	uint32_t dispatches;
+	uint32_t steals;
+} cpu_t;
+
+extern cpu_t cpus[MAX_CPUS];
+/* Processors found in the MP/ACPI tables (at least the boot processor), and those running */
+extern uint32_t cpu_count;
+extern volatile uint32_t cpus_online;
+
+/*
+*   Function: this_cpu
+*   Description: finds the calling processor's cpu_t from its task register: the boot processor uses
+*                KERNEL_TSS (or none yet), application processor n the nth selector from AP_TSS_BASE
+*/
+static inline cpu_t * this_cpu(void)
+{
+	uint32_t selector;
+	asm volatile("str %w0" : "=r"(selector));
+	selector &= 0xFFFF;
+	if (selector < AP_TSS_BASE)
+		return &cpus[0];
+	return &cpus[((selector - AP_TSS_BASE) >> 3) + 1];
+}
+
+/* Per processor state the rest of the kernel uses by name */
+#define current_task			(this_cpu()->current)
+#define idle_task				(this_cpu()->idle)
+#define current_term_executing	(this_cpu()->term_executing)
+
+/* Finds the processors and starts the application processors */
+void init_smp(void);
+
+/* C entry point of an application processor, from ap_boot.S */
+void ap_main(uint32_t id);
+
+/* Big kernel lock: a processor holds it whenever it runs kernel code, until the subsystems get their own
+ * locks (see smp.c) */
+int32_t lock_kernel(void);
+void unlock_kernel(void);
+
+/* Makes the other processors drop their non-global TLB entries, and waits until they did */
+void smp_flush_tlb_others(void);
+
+/* Wakes an idle processor so it can take a task that just became ready */
+void smp_kick_idle_cpu(void);
+
+/* Inter-processor interrupt handlers, called from interrupts.S */
+void tlb_flush_interrupt(void);
+void reschedule_interrupt(void);
+
+/* Prints the processors and their scheduling counters */
+void print_smp_stats(void);
+
+#endif /* ASM */
+
+#endif /* _SMP_H */
@@ -0,0 +1,62 @@
+/*
+*	spinlock.h - spinlocks for data shared between processors
+*/
+#ifndef _SPINLOCK_H
+#define _SPINLOCK_H
+
+#include "types.h"
+#include "lib.h"
+
+/*** Struct: spinlock_t
+*    locked - 1 while a processor holds the lock
+***/
+typedef struct spinlock {
+	volatile uint32_t locked;
+} spinlock_t;
+
+#define SPINLOCK_INIT		{ 0 }
+
+/* Tells the processor it is in a spin-wait loop (rep; nop, a plain nop before the Pentium 4) */
+static inline void cpu_relax(void)
+{
+	asm volatile("pause" : : : "memory");
+}
+
+/* Takes the lock if it is free, returns 1 if it did */
+static inline int32_t spin_trylock(spinlock_t * lock)
+{
+	uint32_t old = 1;
+	asm volatile("xchgl %0, %1" : "+r"(old), "+m"(lock->locked) : : "memory");
+	return old == 0;
+}
+
+/* Spins until the lock is taken, reading it (not writing) while someone else holds it */
+static inline void spin_lock(spinlock_t * lock)
+{
+	while (!spin_trylock(lock))
+		while (lock->locked)
+			cpu_relax();
+}
+
+/* Releases the lock. x86 does not reorder a store with earlier loads or stores */
+static inline void spin_unlock(spinlock_t * lock)
+{
+	asm volatile("" : : : "memory");
+	lock->locked = 0;
+}
+
+/* Takes the lock with interrupts off on this processor, saving EFLAGS in flags */
+#define spin_lock_irqsave(lock, flags)	\
+do {									\
+	cli_and_save(flags);				\
+	spin_lock(lock);					\
+} while (0)
+
+/* Releases the lock and restores the EFLAGS saved by spin_lock_irqsave */
+#define spin_unlock_irqrestore(lock, flags)	\
+do {										\
+	spin_unlock(lock);						\
+	restore_flags(flags);					\
+} while (0)
+
+#endif /* _SPINLOCK_H */
@@ -0,0 +1,29 @@
+/*
+*   stats.c - kernel counters report. Each subsystem keeps its own counters and
+*   prints them; Ctrl+T shows all of them on the current terminal.
+*/
+
+#include "stats.h"
+#include "lib.h"
+#include "paging.h"
+#include "slab.h"
+#include "scheduling.h"
+#include "fpu.h"
+#include "smp.h"
+
+/*
+*   Function: print_kernel_stats
+*   Description: prints the counters of every subsystem on the current screen
+*   inputs: none
+*   outputs: none
+*/
+void
+print_kernel_stats(void)
+{
+	putc('\n');
+	print_tlb_stats();
+	print_slab_stats();
+	print_task_stats();
+	print_fpu_stats();
+	print_smp_stats();
+}
@@ -0,0 +1,12 @@
+/*
+*	stats.h - Function Header File to be used with "stats.c"
+*/
+#ifndef _STATS_H
+#define _STATS_H
+
+#include "types.h"
+
+/* Prints the kernel counters on the current screen (Ctrl+T) */
+void print_kernel_stats(void);
+
+#endif /* _STATS_H */
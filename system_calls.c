@@ -11,14 +11,23 @@
 #include "terminal.h"
 #include "scheduling.h"
 #include "rtc.h"
+#include "elf.h"
+#include "frames.h"
+#include "smp.h"
+#include "interrupts.h"
 
 
 
 /*******************
 * Global Variables *
 ********************/
-/* Process ID Array to start a new process - only can have 6 at a time */
-uint8_t process_id_array [MAX_PROCESSES] = { 0,0,0,0,0,0 };
+/* Process table: the PCB of each process number (NULL for a free one), allocated by execute. It grows
+ * whenever every slot is in use, so how many processes can run is bounded by free memory only */
+pcb_t** pcbs = NULL;
+uint32_t process_table_size = 0;
+
+/* Every pcb comes from here, the kernel stacks are separate frames */
+kmem_cache_t pcb_cache;
 
 
 /* Initialize distinct fops tables for later use */
@@ -45,11 +54,33 @@ halt(uint8_t status){
 	cli();
 
     /* Get current and parent PCB */
-    pcb_t* current_pcb = get_pcb_ptr_process(terms[current_term_executing].active_process_number);
+    pcb_t* current_pcb = current_task;
     pcb_t* parent_pcb = get_pcb_ptr_process(current_pcb->parent_process_number);
 
-	/* Free up a spot in process_id_array */
-    process_id_array[(uint8_t)current_pcb->process_number] = 0;
+	/* The task never runs again, so it must not be queued by the execute below */
+	current_pcb->state = TASK_DEAD;
+	fpu_task_exit(current_pcb);
+
+	/* The terminal's screen may scroll its start again once no process of it has vidmap */
+	if (current_pcb->vidmap_used)
+		current_pcb->term->vidmaps--;
+
+	/* Free up its spot in the process table */
+    pcbs[current_pcb->process_number] = NULL;
+
+	/* Leave this process's address space, then free its pages, page table and page directory,
+	 * dropping its references to shared text pages */
+	loadPageDirectory((uint32_t)pageDirectory);
+	destroyUserPageTable(current_pcb->page_table);
+	destroyPageDirectory(current_pcb->page_directory);
+
+	/* Its kernel stack is the one we are running on, and the pcb is still read below: free the previous
+	 * dead task of this processor instead */
+	if (this_cpu()->dead_task != NULL) {
+		free_frames(VIRT_TO_PHYS(this_cpu()->dead_task->kernel_stack), _8KB / FRAME_SIZE);
+		kmem_cache_free(&pcb_cache, this_cpu()->dead_task);
+	}
+	this_cpu()->dead_task = current_pcb;
 
 	
     /* set all present flags in PCB to "Not In Use" */
@@ -72,15 +103,21 @@ halt(uint8_t status){
 	if (current_pcb->process_number == current_pcb->parent_process_number )
 	{
 		/* If we are trying to halt it, then we are going to execute another shell*/
-		terms[current_term_executing].running = 0;
-		execute((uint8_t *)"shell");
+		current_pcb->term->running = 0;
+		execute_in_term((uint8_t *)"shell", current_pcb->term);
 	}
 
+	/* The parent was blocked in execute, it runs again from here */
+	parent_pcb->state = TASK_RUNNING;
+	charge_cpu_time();
+	fpu_task_switch(current_pcb);
+	current_task = parent_pcb;
+
     /* Restore Page Mapping */
-    remap(_128MB, _8MB + parent_pcb->process_number * _4MB);
+    loadPageDirectory(parent_pcb->page_directory);
     
     /** set esp0 in tss */
-	tss.esp0 = current_pcb->parent_ksp;
+	this_cpu()->tss->esp0 = current_pcb->parent_ksp;
 	
 	sti();
     /* Return from iret */
@@ -117,6 +154,21 @@ halt(uint8_t status){
 */
 int32_t 
 execute(const uint8_t* command){
+	/* The child runs in the terminal of its parent */
+	return execute_in_term(command, current_task != NULL ? current_task->term : &terms[current_term_id]);
+}
+
+/* 
+*	Function execute_in_term()
+*	Description: execute() for a given terminal. If the terminal has no process yet the new one is its
+*		first (its own parent) and the current task, if any, stays runnable; otherwise the new process is
+*		a child of the current task, which blocks until the child halts.
+*	input: 	command -- command you wish to execute
+*			term -- the terminal the process runs in
+*	output: same as execute()
+*/
+int32_t 
+execute_in_term(const uint8_t* command, term_t* term){
 
 	/* Disable interrupts?*/
 	cli();
@@ -124,9 +176,11 @@ execute(const uint8_t* command){
 	/**** STACK VARIABLES ****/
 	int i;
 	int8_t parsed_command[MAX_COMMAND_SIZE], argument[MAX_BUFFER_SIZE];
-	uint8_t buffer[READ_BUFFER_SIZE], command_end, command_start;
+	uint8_t command_end, command_start;
 	int32_t new_process_number;
-	uint32_t entry_point;
+	uint32_t kernel_stack, page_table, page_directory;
+	pcb_t * new_pcb;
+	elf_image_t image;
 
 	/******************************************************
 	 * FIRST: PARSE COMMAND & ARGUMENTS (ARGS IN CHKPT 4) *
@@ -181,23 +235,35 @@ execute(const uint8_t* command){
 	if (0 != read_dentry_by_name((uint8_t*)parsed_command, &test_dentry))
         return -1;
 	
-    /*check first 4 bytes for ELF */
-    read_data(test_dentry.inodeNumber, 0, buffer, READ_BUFFER_SIZE);
-    if ((buffer[0] != ASCII_DEL) || (buffer[1] != ASCII_E) || 
-    	(buffer[2] != ASCII_L) || (buffer[3] != ASCII_F))
-        return -1;
-		
+	/* Read the ELF and program headers once, and check them before taking a process number */
+	if (0 != elf_read_image(test_dentry.inodeNumber, &image))
+		return -1;
 	
-	 
-    /* Obtain the entry point from bytes 24 -> 27 in exe file */
-    read_data(test_dentry.inodeNumber, ENTRY_POINT_START, buffer, READ_BUFFER_SIZE);
-    entry_point = *((uint32_t*)buffer);
-    
 	/* Get new process number */
 	new_process_number = get_available_process_number();
 	/* If we have no room for process, return -1 */
     if (new_process_number == -1)
     	return -1;
+	/* Allocate the PCB, the kernel stack, the user page table and the page directory */
+	new_pcb = kmem_cache_alloc(&pcb_cache);
+	kernel_stack = alloc_frames(_8KB / FRAME_SIZE);
+	page_table = createUserPageTable();
+	page_directory = page_table ? createPageDirectory(page_table) : 0;
+	if (new_pcb == NULL || kernel_stack == 0 || page_directory == 0)
+	{
+		if (new_pcb != NULL)
+			kmem_cache_free(&pcb_cache, new_pcb);
+		if (kernel_stack != 0)
+			free_frames(kernel_stack, _8KB / FRAME_SIZE);
+		if (page_directory != 0)
+			destroyPageDirectory(page_directory);
+		if (page_table != 0)
+			free_frame(page_table);
+		printf("Out of memory. ");
+		return -1;
+	}
+	new_pcb->kernel_stack = PHYS_TO_VIRT(kernel_stack);
+	pcbs[new_process_number] = new_pcb;
 	/* Initializing the pcb ptr based on the process number*/
  	pcb_t * process_control_block = get_pcb_ptr_process(new_process_number);
 	/* Saving the current ESP and EBP into the PCB struct */
@@ -213,16 +279,19 @@ execute(const uint8_t* command){
 	 * THIRD: SETUP PAGING *
      ***********************/
 
-    /* Map a new page in virtual address 0x8000000 to physical address 0x800000 */
-	remap(_128MB, _8MB + new_process_number * _4MB);
+    /* Switch to the new process's page directory, its page table at 0x8000000 has nothing present yet */
+	process_control_block->page_table = page_table;
+	process_control_block->page_directory = page_directory;
+	loadPageDirectory(page_directory);
 
 
 	/***********************
 	 * FOURTH: FILE LOADER *
      ***********************/
 
-	/* copy entire file to 0x08048000 in virtual memory*/
-    read_data(test_dentry.inodeNumber, 0, (uint8_t*)LOAD_ADDRESS, LARGENUMBER);
+	/* Nothing is copied here: each page is read from the file the first time it
+	 * is touched (see handle_page_fault), starting with the one holding the entry point */
+	process_control_block->image = image;
 
 
 	/***************************************
@@ -234,20 +303,35 @@ execute(const uint8_t* command){
  	/* Set up current process number = WILL NEED TO CHANGE FOR CHECKPOINT 4 */
  	process_control_block->process_number = new_process_number;
 
-	if (terms[current_term_id].running == 0)//check if program is first one in terminal
+	if (term->running == 0)//check if program is first one in terminal
 	{
-		current_term_executing = current_term_id;
-
 		//set parent equal to self and mark terminal as running
 		process_control_block->parent_process_number = process_control_block->process_number;
-		terms[current_term_id].running = 1;
+		term->running = 1;
+
+		/* A task of another terminal was interrupted to launch this one, it keeps running later */
+		if (current_task != NULL && current_task->state == TASK_RUNNING)
+			task_ready(current_task);
 	}
 	else 
 	{
-		/* Set parent process number normally */
-		parent_PCB = get_pcb_ptr_process(terms[current_term_id].active_process_number);
+		/* Set parent process number normally, the parent waits in execute until the child halts */
+		parent_PCB = current_task;
 		process_control_block->parent_process_number = parent_PCB->process_number;
+		parent_PCB->state = TASK_BLOCKED;
 	}
+	current_term_executing = term->id;
+	process_control_block->state = TASK_RUNNING;
+	process_control_block->run_next = NULL;
+	set_task_level(process_control_block, 0);
+	process_control_block->slice_left = process_control_block->slice_ticks;
+	process_control_block->cpu_ticks = 0;
+	process_control_block->cpu_cycles = 0;
+	process_control_block->fpu_used = 0;
+	process_control_block->vidmap_used = 0;
+	charge_cpu_time();
+	fpu_task_switch(current_task);
+	current_task = process_control_block;
 
 	/* Debugging */
 	//printf("executing process number %d and parent number %d \n", process_control_block->process_number, process_control_block->parent_process_number);
@@ -284,26 +368,28 @@ execute(const uint8_t* command){
 	 * UPDATE TERMINAL DETAILS 	*
 	 ****************************/
 	/* Update the term number to be the current terminal we want to execute */
-	process_control_block->term = &terms[current_term_id];
+	process_control_block->term = term;
 	/* Set active process number on our current terminal */
-	terms[current_term_id].active_process_number = process_control_block->process_number;
+	term->active_process_number = process_control_block->process_number;
 
 	/************************
 	 * LAST: CONTEXT SWITCH *
      ************************/
 
     /* Save SS0 and ESP0 in tss for context switching */
-    tss.ss0 = KERNEL_DS;
-    tss.esp0 = _8MB - _8KB * (new_process_number) - 4;
-
-
-    /*Re-enable Interrupts?*/
-    sti();
+    this_cpu()->tss->ss0 = KERNEL_DS;
+    this_cpu()->tss->esp0 = KERNEL_STACK_TOP(process_control_block);
 
+    /* Interrupts stay off until the iret: we are still on the stack of the previous task, which may
+     * already be in the run queue. The iret below turns them back on (IF in the pushed EFLAGS).
+     * The iret frame goes on the new task's empty kernel stack, so the kernel lock can be given up
+     * before the previous task's stack is left: another processor may resume that task right away */
 
     /* Pushing "artificial iret" onto stack */
     asm volatile(
                  "cli;"
+                 "movl %1, %%esp;"
+                 "call unlock_kernel;"
                  "mov $0x2B, %%ax;"
                  "mov %%ax, %%ds;"
                  "movl $0x83FFFFC, %%eax;"
@@ -320,8 +406,8 @@ execute(const uint8_t* command){
                  "LEAVE;"
                  "RET;"
                  :	/* no outputs */
-                 :"r"(entry_point)	/* input */
-                 :"%edx","%eax"	/* clobbered register */
+                 :"r"(image.entry), "r"(KERNEL_STACK_TOP(process_control_block))	/* input */
+                 :"%edx","%eax","%ecx","memory"	/* clobbered register */
                  );
 
     /* Should never reach this point due to iret *
@@ -369,7 +455,7 @@ read(int32_t fd, void* buf, int32_t nbytes){
 int32_t 
 write(int32_t fd, const void* buf, int32_t nbytes){
 	/* Get current PCB Pointer */
-	pcb_t *pcb = get_pcb_ptr_process(terms[current_term_executing].active_process_number);
+	pcb_t *pcb = current_task;
 	/* Bounds Check 0 -> 7 */
 	if (fd < 0 || fd > MAX_FD)
 		return -1;
@@ -503,10 +589,24 @@ vidmap(uint8_t ** screen_start){
 	{
 		return -1;
 	}
-	remapWithPageTable((uint32_t)_136MB, (uint32_t)VIDEO);
-	*screen_start = (uint8_t*)_136MB;
-
-	return _136MB;
+	/* The terminal's page table points at the start of the terminal's video memory */
+	pcb_t* pcb = get_pcb_ptr();
+	uint32_t flags;
+	mapVidmap(pcb->page_directory, pcb->term->id);
+	/* Scroll the terminal's screen back to that page, it stays there until the process halts */
+	cli_and_save(flags);
+	if (!pcb->vidmap_used) {
+		pcb->vidmap_used = 1;
+		pcb->term->vidmaps++;
+	}
+	if (pcb->term->id == current_term_id)
+		reset_screen_start();
+	else
+		reset_screen_start_term_exec();
+	restore_flags(flags);
+	*screen_start = (uint8_t*)VIDMAP_START;
+
+	return VIDMAP_START;
 }
 
 
@@ -533,24 +633,34 @@ sigreturn(void){
 
 /* 
 *	Function get_available_process_number()
-*	Description: gets the next available process number using the process id array
+*	Description: gets the next available process number using the process table, doubling the table
+*				 when every slot is in use. The slot stays free until execute puts the new pcb in it
 *	input: none
 *	output: returns the next available process number upon success, -1 upon failure
-*	effect: none
+*	effect: may replace pcbs with a larger table
 */
 int32_t get_available_process_number()
 {
 	/* Determine the next available process number */
-    int32_t i;
-    for (i = 0; i < MAX_PROCESSES; i++) 
+    uint32_t i, new_size;
+    pcb_t** table;
+    for (i = 0; i < process_table_size; i++) 
     {
-        if (process_id_array[i] == 0) 
-        {
-        	process_id_array[i] = 1;
+        if (pcbs[i] == NULL) 
 	    	return i;
-        }
     }
-    /* Return -1 if there is no more processes available */
+    /* Every slot is in use: move to a table twice as large, its first new slot is free */
+    new_size = process_table_size ? 2 * process_table_size : PROCESS_TABLE_MIN;
+    if ((table = kmalloc(new_size * sizeof(pcb_t*))) != NULL)
+    {
+        memcpy(table, pcbs, process_table_size * sizeof(pcb_t*));
+        memset(table + process_table_size, 0, (new_size - process_table_size) * sizeof(pcb_t*));
+        kfree(pcbs);
+        pcbs = table;
+        process_table_size = new_size;
+        return i;
+    }
+    /* Return -1 if there is no memory left for a larger table */
     printf("Too many processes running. ");
     return -1;
 }
@@ -563,17 +673,21 @@ int32_t get_available_process_number()
 *	effect: none
 */
 pcb_t* get_pcb_ptr(void){
-	pcb_t* ptr;
-	asm volatile("				   \n\
-				andl %%esp, %%eax  \n\
-				"
-				:"=a"(ptr)
-				:"a"(PCB_PTR_MASK)
-				:"cc"
-				);
-	return ptr;
+	return current_task;
 };
 
+/*
+*	Function init_pcb_cache()
+*	Description: sets up the cache every pcb is allocated from
+*	input: none
+*	output: none
+*	effect: needs init_slab
+*/
+void init_pcb_cache(void)
+{
+	kmem_cache_init(&pcb_cache, "pcb", sizeof(pcb_t));
+}
+
 /*
 *	Function get_pcb_ptr()
 *	Description: gets a pointer to the current pcd struct
@@ -583,7 +697,7 @@ pcb_t* get_pcb_ptr(void){
 */
 pcb_t * get_pcb_ptr_process(uint32_t process)
 {
-	return (pcb_t *)(_8MB - (process + 1) * _8KB);
+	return pcbs[process];
 }
 
 
@@ -598,3 +712,34 @@ int32_t failure_function()
 {
     return -1;
 }
+
+
+/* Set when the processors take system calls through sysenter as well as int 0x80 */
+uint32_t sysenter_enabled = 0;
+
+/*
+*	Function init_sysenter()
+*	Description: points the calling processor's SYSENTER MSRs at sysenter_handler (interrupts.S). The
+*				 stack pointer sysenter loads is the processor's TSS, the handler takes esp0 from it
+*	input: none
+*	output: none
+*	effect: does nothing if the processor has no SYSENTER/SYSEXIT (the Pentium Pro reports them
+*			without having them)
+*/
+void init_sysenter(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx;
+	uint32_t family, model, stepping;
+
+	asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	family = (eax >> 8) & 0xF;
+	model = (eax >> 4) & 0xF;
+	stepping = eax & 0xF;
+	if (!(edx & CPUID_SEP) || (family == 6 && model < 3 && stepping < 3))
+		return;
+
+	wrmsr(MSR_SYSENTER_CS, KERNEL_CS);
+	wrmsr(MSR_SYSENTER_ESP, (uint32_t)this_cpu()->tss);
+	wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_handler);
+	sysenter_enabled = 1;
+}
@@ -6,9 +6,10 @@
 
 #include "types.h"
 #include "terminal.h"
+#include "elf.h"
+#include "fpu.h"
+#include "slab.h"
 
-#define PCB_PTR_MASK 0xFFFFE000 
-#define LARGENUMBER 100000
 #define LOAD_ADDRESS 0x8048000
 #define IN_USE 0x0001
 #define NOT_IN_USE 0x0000
@@ -21,14 +22,31 @@
 #define MIN_FD		2
 #define MAX_FD		7   
 
+/* SYSENTER model specific registers: code segment (SS is the next selector), stack pointer, entry point */
+#define MSR_SYSENTER_CS		0x174
+#define MSR_SYSENTER_ESP	0x175
+#define MSR_SYSENTER_EIP	0x176
+/* CPUID leaf 1 EDX: SYSENTER/SYSEXIT */
+#define CPUID_SEP			0x00000800
+
 #define MAX_FILES 8
-#define MAX_PROCESSES 6
+/* Slots the process table starts with, it doubles whenever they are all in use */
+#define PROCESS_TABLE_MIN 8
+/* Process number of the idle tasks, which are not in the process table */
+#define NO_PROCESS -1
+/* Each pcb has its own 8KB kernel stack, the TSS points the CPU at the top */
+#define KERNEL_STACK_TOP(pcb) ((pcb)->kernel_stack + _8KB - 4)
+
+/* Task states */
+#define TASK_RUNNING	0
+#define TASK_READY		1
+#define TASK_BLOCKED	2
+#define TASK_DEAD		3
 
 #define FILE_NAME_SIZE 32
 #define MAX_COMMAND_SIZE 10
 #define MAX_BUFFER_SIZE 100
 #define READ_BUFFER_SIZE 4
-#define ENTRY_POINT_START 24
 
 /*** Struct: fops_table
 *     Read: function pointer to a specific read function
@@ -61,24 +79,54 @@ typedef struct {
 *    fds[8] - array of file descriptors - contain each file that the process has open. 
 *    filenames[8][32] - array holding the names of each of the open files 
 *    parent_ksp, parent_kbp - The kernel stack & base pointer of the parent process. Used upon halt
-*    process_number, parent_process_number - Process number of this process. Number from 1-7.
+*    process_number, parent_process_number - Process number of this process and its parent, their slots in pcbs
 *    argbuf - Buffer for the arguments of this process.  
 *    ksp_before_change, kbp_before_change - This variable stores the KSP, KBP right before switching processes.  
+*    image - the executable this process runs, its pages are loaded from it on page faults
+*    page_table - physical address of the page table for the user region of this process
+*    page_directory - physical address of this process's page directory, loaded into CR3 when it runs
+*    esp - switch frame (switch.S) on the kernel stack while the task is not running
+*    state - TASK_RUNNING, TASK_READY (in the run queue), TASK_BLOCKED or TASK_DEAD
+*    run_next - next task in the run queue
+*    level - feedback queue level, 0 is the highest priority
+*    slice_ticks - ticks the task may run before it is preempted, slice_left - ticks left of the current slice
+*    cpu_ticks - ticks the task was running on, cpu_cycles - time stamp counter cycles it ran for
+*    fpu_used - the task has FPU registers, fpu_state - where they are kept while another task owns the FPU
+*    vidmap_used - the task called vidmap, counted in its terminal's vidmaps
+*    kernel_stack - bottom of its 8KB kernel stack
 ***/ 
-typedef struct { 
+typedef struct pcb { 
 	file_desc_t fds[MAX_FILES]; 
 	uint8_t filenames[MAX_FILES][FILE_NAME_SIZE];  
 	uint32_t parent_ksp; 
 	uint32_t parent_kbp; 
-	uint8_t process_number; 
-	uint8_t parent_process_number; 
+	int32_t process_number; 
+	int32_t parent_process_number; 
 	int8_t argbuf[MAX_BUFFER_SIZE]; 
 	term_t * term;
     uint32_t esp;
-    uint32_t ebp;
+	elf_image_t image;
+	uint32_t page_table;
+	uint32_t page_directory;
+	uint8_t state;
+	struct pcb * run_next;
+	uint32_t level;
+	uint32_t slice_ticks;
+	uint32_t slice_left;
+	uint32_t cpu_ticks;
+	uint64_t cpu_cycles;
+	uint8_t fpu_used;
+	fpu_state_t fpu_state;
+	uint8_t vidmap_used;
+	uint32_t kernel_stack;
  } pcb_t; 
  
- extern uint8_t process_id_array [MAX_PROCESSES];
+ extern pcb_t** pcbs;
+ extern uint32_t process_table_size;
+ extern kmem_cache_t pcb_cache;
+
+/* Sets up the cache pcbs come from, once the kernel heap is ready */
+void init_pcb_cache(void);
 
 /* Halt System Call */
 int32_t halt (uint8_t status);
@@ -86,6 +134,9 @@ int32_t halt (uint8_t status);
 /* Execute System Call */
 int32_t execute (const uint8_t* command);
 
+/* Execute a program as a child of the current task, or as the first process of term */
+int32_t execute_in_term (const uint8_t* command, term_t* term);
+
 /* Read System Call */
 int32_t read (int32_t fd, void* buf, int32_t  nbytes);
 
@@ -121,5 +172,9 @@ int32_t get_available_process_number();
 /* Return -1 function */
 int32_t failure_function();
 
+/* Sets up the calling processor's sysenter entry, next to int 0x80 */
+void init_sysenter(void);
+extern uint32_t sysenter_enabled;
+
 
 #endif
@@ -12,15 +12,33 @@
 volatile uint8_t current_term_id;
 term_t terms[TERM_COUNT];
 
+/* Attribute byte of each terminal's text */
+const uint8_t term_attribs[TERM_COUNT] = { ATTRIB_TERM1, ATTRIB_TERM2, ATTRIB_TERM3 };
+
 
 /*
 *   Function: init_terms()
-*   Description: Initializes the terminals
+*   Description: Initializes the terminals and starts the first shell. Called by the idle task, it returns
+*                the first time the scheduler switches to the idle task
 *   inputs: none
 *   outputs: none
 *   effects: 
 */
 void init_terms() {
+	init_term_screens();
+
+    /* Run the first shell as a new task, the idle task resumes from here (and returns to entry) */
+	switch_to_new_task(&idle_task->esp, (uint8_t*)"shell", &terms[0]);
+}
+
+/*
+*   Function: init_term_screens()
+*   Description: Initializes the terminals, each with a blank screen in its own part of video memory, and
+*                displays the first one
+*   inputs: none
+*   outputs: none
+*/
+void init_term_screens() {
 	uint8_t i;
 	uint32_t j;
 	for (i = 0; i < TERM_COUNT; i++) {
@@ -31,30 +49,24 @@ void init_terms() {
 		terms[i].y_pos = 0;
 		terms[i].key_buffer_idx = 0;
 		terms[i].enter_flag = 0;
+		terms[i].read_queue.head = NULL;
+		terms[i].read_queue.tail = NULL;
 		for (j = 0; j < KEY_BUFFER_SIZE; j++)
 			terms[i].key_buffer[j] = '\0';
 
-		// Change to different address for each term
-		remapWithPageTableToPage(_100MB, _100MB+((i+1)*_4KB), i+1);
-		terms[i].video_mem = (uint8_t *)_100MB+((i+1)*_4KB);
-		// clear the memory
-		for (j = 0; j < NUM_ROWS*NUM_COLS; j++) {
-			*(uint8_t *)(terms[i].video_mem + (j << 1)) = ' ';
-			//set color attributes for each terminal
-        	if (i == 0)
-        		*(uint8_t *)(terms[i].video_mem + (j << 1) + 1) = ATTRIB_TERM1;
-	    	if (i == 1)
-        		*(uint8_t *)(terms[i].video_mem + (j << 1) + 1) = ATTRIB_TERM2;
-	   		if (i == 2)
-        		*(uint8_t *)(terms[i].video_mem + (j << 1) + 1) = ATTRIB_TERM3;
-		}
+		// Each term gets its own part of video memory, vidmap always maps the start of it
+		terms[i].video_mem = (uint8_t *)VIDEO + i*TERM_VIDEO_SIZE;
+		terms[i].origin = 0;
+		terms[i].vidmaps = 0;
+		mapTerminalVideo(i, (uint32_t)terms[i].video_mem);
+		// clear the screen with the terminal's color
+		memset_word(terms[i].video_mem, ' ' | (term_attribs[i] << 8), NUM_ROWS*NUM_COLS);
 	}
 
 	// start up the first terminal
 	key_buffer = terms[0].key_buffer;
 	restore_term_state(0);
 	current_term_id = 0;
-	execute((uint8_t*)"shell");
 }
 
 /*
@@ -79,12 +91,6 @@ launch_term(uint8_t term_id) {
 			return -1;
 		key_buffer = terms[term_id].key_buffer;
 		current_term_id = term_id;
-        /* Remap video memory to 136 MB */
-        uint8_t * screen_start;
-        vidmap(&screen_start);
-        if (terms[current_term_executing].id != current_term_id) {
-            remapVideoWithPageTable((uint32_t)screen_start, (uint32_t)terms[current_term_executing].video_mem);
-        }
 
 		return 0;
 	}
@@ -95,48 +101,40 @@ launch_term(uint8_t term_id) {
 
 	// Launch new term
 	current_term_id = term_id;
-	pcb_t * old_pcb = get_pcb_ptr_process(terms[current_term_executing].active_process_number);
+	pcb_t * old_pcb = current_task;
 	key_buffer = terms[term_id].key_buffer;
 	restore_term_state(term_id);
 	
 	
 	
-    /* Save the ebp/esp of the process we are switching away from. */
-    asm volatile("			\n\
-                 movl %%ebp, %%eax 	\n\
-                 movl %%esp, %%ebx 	\n\
-                 "
-                 :"=a"(old_pcb->ebp), "=b"(old_pcb->esp)
-	);
-	sti();
-	execute((uint8_t*)"shell");
+    /* Start the new shell, the process we are switching away from resumes from here once it is scheduled.
+     * Interrupts stay off: the iret into the shell turns them on */
+	switch_to_new_task(&old_pcb->esp, (uint8_t*)"shell", &terms[term_id]);
 	return 0;
 }
 
 /*
 *   Function: save_term_state(uint8_t term_id)
-*   Description: saves the state of a terminal
+*   Description: saves the state of a terminal that stops being displayed. Its screen stays where it is in
+*                video memory, where its processes keep drawing
 *   inputs: term_id -- terminal number of the terminal to save the state of
 *   outputs: returns 0 on success
 */
 int32_t
 save_term_state(uint8_t term_id) {
-    /* Since the terminal we are switching away from is no longer being viewed, we need to map virtual vidmem to the buffer */
-    //remapVideoWithPageTable(_136MB, (uint32_t)terms[term_id].video_mem);
-    
 	terms[term_id].key_buffer_idx = key_buffer_idx;
 
 	terms[term_id].x_pos = get_screen_x();
 	terms[term_id].y_pos = get_screen_y();
-
-	memcpy((uint8_t *)terms[term_id].video_mem, (uint8_t *)VIDEO, 2*NUM_ROWS*NUM_COLS);
+	terms[term_id].origin = get_screen_origin();
 
 	return 0;
 }
 
 /*
 *   Function: restore_term_state(uint8_t term_id)
-*   Description: restores the state of a terminal
+*   Description: restores the state of a terminal and displays it, by pointing the CRTC start address
+*                at its screen
 *   inputs: term_id -- terminal number of the terminal to restore the state of
 *   outputs: returns 0 on success
 */
@@ -144,8 +142,8 @@ int32_t
 restore_term_state(uint8_t term_id) {
 	key_buffer_idx = terms[term_id].key_buffer_idx;
 
+	set_screen_mem(terms[term_id].video_mem, terms[term_id].origin);
 	set_screen_pos(terms[term_id].x_pos, terms[term_id].y_pos);
-	memcpy((uint8_t *)VIDEO, (uint8_t *)terms[term_id].video_mem, 2*NUM_ROWS*NUM_COLS);
 
 	return 0;
 }
@@ -205,8 +203,14 @@ int32_t
 terminal_read(int32_t fd, void* buf, int32_t nbytes) {
 
 	uint8_t i;
-	while (get_pcb_ptr()->term->enter_flag == 0);
-	get_pcb_ptr()->term->enter_flag = 0;
+	term_t * term = get_pcb_ptr()->term;
+
+	/* Sleep until handle_enter wakes us up */
+	cli();
+	while (term->enter_flag == 0)
+		sleep_on(&term->read_queue);
+	term->enter_flag = 0;
+	sti();
 	
 	int8_t * buffer = (int8_t *)buf;
 
@@ -220,19 +224,22 @@ terminal_read(int32_t fd, void* buf, int32_t nbytes) {
 
 /*
 *	Function: terminal_write(int8_t* buf, int32_t nbytes)
-*	Description: Writes a string to the terminal
+*	Description: Writes exactly nbytes bytes to the terminal, as they are (no format sequences, NULs
+*				 included), with the cursor moved once at the end (see write_screen)
 *	inputs:	 a pointer to a buffer and the number of btyes to write
-*	outputs: the number of bytes displayed
+*	outputs: the number of bytes displayed, -1 if nbytes is negative
 *	effects: writes to screen
 */
 int32_t 
 terminal_write(int32_t fd, const void* buf, int32_t nbytes) {
 	int32_t temp;
+	if (nbytes < 0)
+		return -1;
 	cli();
 	if (current_term_id == current_term_executing)
-		temp = printf((int8_t *)buf);
+		temp = write_screen((const uint8_t *)buf, nbytes);
 	else
-		temp = printf_terminal_running((int8_t *)buf);
+		temp = write_screen_term_exec((const uint8_t *)buf, nbytes);
 	sti();
 	return temp;
 }
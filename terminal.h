@@ -3,16 +3,23 @@
 
 #include "types.h"
 #include "keyboard.h"
+#include "wait_queue.h"
+#include "lib.h"
 
 #define TERM_COUNT  3
 
+/* Each terminal draws into its own part of text mode video memory, all the time. The displayed one is
+ * chosen with the CRTC start address, and a screen scrolls through its part TERM_VIDEO_ROWS rows long */
+#define TERM_VIDEO_SIZE	0x2000
+#define TERM_VIDEO_ROWS	(TERM_VIDEO_SIZE / (2*NUM_COLS))
+
 /**TERMINAL STRUCT **/
 typedef struct {
     // terminal id (ie. 0, 1, 2)
     uint8_t id;
 	
 	//active process number
-	int8_t active_process_number;
+	int32_t active_process_number;
 
     // whether terminal has a process running
     uint8_t running;
@@ -26,17 +33,26 @@ typedef struct {
     volatile uint8_t key_buffer_idx;
 
     volatile uint8_t enter_flag;
+    // tasks waiting in terminal_read for enter_flag
+    wait_queue_t read_queue;
 
-    //ptr to video memory for terminal
+    //ptr to video memory for terminal, and the cell of it at the top left of the screen
+    //(kept up to date only while the terminal is not displayed, lib.c tracks the displayed one)
     uint8_t *video_mem;
+    uint32_t origin;
+
+    //processes of the terminal that have vidmap, its screen stays at the start of its video memory while any do
+    uint8_t vidmaps;
 } term_t;
 
 /* Global Variables */
 extern volatile uint8_t current_term_id;
 extern term_t terms[TERM_COUNT];
+extern const uint8_t term_attribs[TERM_COUNT];
 
 /*Function Definitions */
 void init_terms(void);
+void init_term_screens(void);
 int32_t launch_term(uint8_t term_id);
 int32_t save_term_state(uint8_t term_id);
 int32_t restore_term_state(uint8_t term_id);
@@ -0,0 +1,78 @@
+/*
+*   time_page.c - keeps the time page up to date. Only the boot processor writes it, from its tick with
+*   interrupts off, so the sequence count is all readers need
+*/
+
+#include "time_page.h"
+#include "paging.h"
+#include "frames.h"
+#include "scheduling.h"
+#include "rtc.h"
+#include "lib.h"
+#include "types.h"
+
+/* The time page through the direct map, NULL until init_time_page */
+static time_page_t * time_page = NULL;
+
+/* Marks the start and end of an update: seq is odd in between */
+static inline void
+time_page_write_begin(void)
+{
+	time_page->seq++;
+	asm volatile("" : : : "memory");
+}
+
+static inline void
+time_page_write_end(void)
+{
+	asm volatile("" : : : "memory");
+	time_page->seq++;
+}
+
+/*
+*   Function: init_time_page
+*   Description: takes a frame for the time page, fills it in and maps it for every process
+*   inputs: none
+*   outputs: none
+*   effects: must run before the first process is created (see mapTimePage). Without a free frame
+*            there is no time page, and TIME_PAGE_START stays unmapped
+*/
+void
+init_time_page(void)
+{
+	uint32_t frame = alloc_frame();
+	uint32_t flags;
+
+	if (frame == 0)
+		return;
+	memset((void *)PHYS_TO_VIRT(frame), 0, FRAME_SIZE);
+
+	cli_and_save(flags);
+	time_page = (time_page_t *)PHYS_TO_VIRT(frame);
+	time_page->boot_seconds = rtc_read_seconds();
+	time_page_tick(pit_ticks, rdtsc());
+	mapTimePage(frame);
+	restore_flags(flags);
+}
+
+/*
+*   Function: time_page_tick
+*   Description: publishes the tick count and the time stamp counter at that tick, with the current
+*                tick rate and calibration, and the wall clock they give
+*   inputs: ticks -- ticks since boot
+*           tick_tsc -- time stamp counter at that tick
+*   outputs: none
+*/
+void
+time_page_tick(uint32_t ticks, uint64_t tick_tsc)
+{
+	if (time_page == NULL)
+		return;
+	time_page_write_begin();
+	time_page->ticks = ticks;
+	time_page->tick_hz = pit_hz;
+	time_page->tsc_per_tick = tsc_per_tick;
+	time_page->tick_tsc = tick_tsc;
+	time_page->seconds = time_page->boot_seconds + ticks / pit_hz;
+	time_page_write_end();
+}
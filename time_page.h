@@ -0,0 +1,37 @@
+/*
+*	time_page.h - the time page: a page the kernel keeps the time in, mapped read only into every
+*	process at TIME_PAGE_START (paging.h), so programs can read the time without a system call
+*/
+#ifndef _TIME_PAGE_H
+#define _TIME_PAGE_H
+
+#include "types.h"
+
+/*** Struct: time_page_t - the start of the time page, the layout user programs read
+*    seq - odd while the kernel updates the page. A reader reads seq, the fields, then seq again, and
+*          reads again if the two differ or are odd
+*    ticks - scheduler ticks since boot, as of the boot processor's last tick
+*    tick_hz - ticks per second
+*    tsc_per_tick - time stamp counter cycles per tick, 0 until the local APIC tick is calibrated
+*    tick_tsc - time stamp counter at tick number ticks. The ticks since then are
+*               (rdtsc - tick_tsc) / tsc_per_tick, as the boot processor does not tick while it idles
+*    boot_seconds - wall clock at boot, seconds since 1970 (from the CMOS clock)
+*    seconds - wall clock, boot_seconds + ticks / tick_hz
+***/
+typedef struct time_page {
+	volatile uint32_t seq;
+	volatile uint32_t ticks;
+	volatile uint32_t tick_hz;
+	volatile uint32_t tsc_per_tick;
+	volatile uint64_t tick_tsc;
+	volatile uint32_t boot_seconds;
+	volatile uint32_t seconds;
+} time_page_t;
+
+/* Allocates and maps the time page, once the tick rate is set (init_PIT) */
+void init_time_page(void);
+
+/* Publishes a new tick count, interrupts must be off */
+void time_page_tick(uint32_t ticks, uint64_t tick_tsc);
+
+#endif /* _TIME_PAGE_H */
@@ -11,8 +11,10 @@
 #define _128MB 0x8000000
 #define _132MB 0x8400000
 #define _136MB 0x8800000
+#define _140MB 0x8C00000
 #define _100MB 0x6400000
 #define _8MB 0x800000
+#define _1MB 0x100000
 #define _4MB 0x400000
 #define _8KB 0x2000
 #define _4KB 0x1000
@@ -26,6 +28,9 @@
 #ifndef ASM
 
 /* Types defined here just like in <stdint.h> */
+typedef long long int64_t;
+typedef unsigned long long uint64_t;
+
 typedef int int32_t;
 typedef unsigned int uint32_t;
 
@@ -0,0 +1,222 @@
+/*
+*   sysbench.c - user program comparing the int 0x80 and sysenter system call paths.
+*   Times SYSBENCH_CALLS round trips of system call 0, which both paths reject with -1
+*   right after the kernel entry, so only the entry and exit themselves are measured.
+*   Then times SYSBENCH_READS one byte reads of a file made one at a time and as one
+*   io_ring_enter batch.
+*   Built outside the kernel Makefile and copied into filesys_img as "sysbench":
+*   gcc -m32 -nostdlib -static -fno-builtin -fno-stack-protector -fno-pie -no-pie -O2 -s
+*       -Wl,-N -Wl,--build-id=none -Ttext=0x8048000 -o sysbench sysbench.c
+*/
+
+typedef unsigned int uint32_t;
+typedef int int32_t;
+typedef unsigned long long uint64_t;
+
+#define SYSBENCH_CALLS	1000
+
+#define SYS_HALT		1
+#define SYS_READ		3
+#define SYS_WRITE		4
+#define SYS_OPEN		5
+#define SYS_CLOSE		6
+#define SYS_IO_RING_ENTER	11
+#define SYS_INVALID		0
+#define STDOUT			1
+
+#define SYSBENCH_READS	32
+#define SYSBENCH_FILE	"frame0.txt"
+
+/* The io_ring_t layout of io_ring.h */
+#define IO_RING_ENTRIES	32
+#define IO_OP_READ		1
+
+typedef struct io_sqe {
+	uint32_t op;
+	int32_t fd;
+	uint32_t buf;
+	int32_t nbytes;
+	uint32_t user_data;
+} io_sqe_t;
+
+typedef struct io_cqe {
+	uint32_t user_data;
+	int32_t result;
+} io_cqe_t;
+
+typedef struct io_ring {
+	volatile uint32_t sq_head;
+	volatile uint32_t sq_tail;
+	volatile uint32_t cq_head;
+	volatile uint32_t cq_tail;
+	io_sqe_t sq[IO_RING_ENTRIES];
+	io_cqe_t cq[IO_RING_ENTRIES];
+} io_ring_t;
+
+static io_ring_t ring;
+static char read_buf[SYSBENCH_READS];
+
+/* CPUID leaf 1 EDX: SYSENTER/SYSEXIT */
+#define CPUID_SEP		0x00000800
+
+int32_t int80_call(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+int32_t sysenter_call(uint32_t num, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+/*
+*   The two system call stubs. sysenter_call keeps ecx, edx, ebp and its resume address
+*   on the stack for the kernel's sysexit, as interrupts.S expects
+*/
+asm (
+	".text\n"
+	"int80_call:\n"
+	"	pushl	%ebx\n"
+	"	movl	8(%esp), %eax\n"
+	"	movl	12(%esp), %ebx\n"
+	"	movl	16(%esp), %ecx\n"
+	"	movl	20(%esp), %edx\n"
+	"	int		$0x80\n"
+	"	popl	%ebx\n"
+	"	ret\n"
+	"sysenter_call:\n"
+	"	pushl	%ebx\n"
+	"	movl	8(%esp), %eax\n"
+	"	movl	12(%esp), %ebx\n"
+	"	movl	16(%esp), %ecx\n"
+	"	movl	20(%esp), %edx\n"
+	"	pushl	%ecx\n"
+	"	pushl	%edx\n"
+	"	pushl	%ebp\n"
+	"	pushl	$1f\n"
+	"	movl	%esp, %ebp\n"
+	"	sysenter\n"
+	"1:	addl	$4, %esp\n"
+	"	popl	%ebp\n"
+	"	popl	%edx\n"
+	"	popl	%ecx\n"
+	"	popl	%ebx\n"
+	"	ret\n"
+);
+
+static inline uint64_t
+rdtsc(void)
+{
+	uint64_t tsc;
+	asm volatile("rdtsc" : "=A"(tsc));
+	return tsc;
+}
+
+static uint32_t
+has_sysenter(void)
+{
+	uint32_t eax = 1, ebx, ecx, edx;
+	asm volatile("cpuid" : "+a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx));
+	/* The Pentium Pro reports SEP without having the instructions */
+	if (((eax >> 8) & 0xF) == 6 && ((eax >> 4) & 0xF) < 3 && (eax & 0xF) < 3)
+		return 0;
+	return (edx & CPUID_SEP) != 0;
+}
+
+static void
+print(const char* s)
+{
+	uint32_t len = 0;
+	while (s[len] != '\0')
+		len++;
+	int80_call(SYS_WRITE, STDOUT, (uint32_t)s, len);
+}
+
+static void
+print_uint(uint32_t value)
+{
+	char buf[11];
+	int i = sizeof(buf) - 1;
+	buf[i] = '\0';
+	do {
+		buf[--i] = '0' + value % 10;
+		value /= 10;
+	} while (value != 0);
+	print(&buf[i]);
+}
+
+/*
+*   Function: time_calls
+*   Description: makes SYSBENCH_CALLS invalid system calls through call and prints the
+*                average cycles per round trip
+*/
+static void
+time_calls(const char* name, int32_t (*call)(uint32_t, uint32_t, uint32_t, uint32_t))
+{
+	uint64_t start, cycles;
+	int i;
+
+	/* Once untimed, so the first call's misses don't count */
+	call(SYS_INVALID, 0, 0, 0);
+	start = rdtsc();
+	for (i = 0; i < SYSBENCH_CALLS; i++)
+		call(SYS_INVALID, 0, 0, 0);
+	cycles = rdtsc() - start;
+
+	print(name);
+	print(": ");
+	print_uint((uint32_t)cycles / SYSBENCH_CALLS);
+	print(" cycles per system call\n");
+}
+
+/*
+*   Function: time_reads
+*   Description: reads the first SYSBENCH_READS bytes of SYSBENCH_FILE one byte at a time, with
+*                one read call each or with one io_ring_enter for all of them
+*   outputs: the cycles it took, 0 if the file can not be opened
+*/
+static uint32_t
+time_reads(uint32_t batched)
+{
+	uint64_t start, cycles;
+	int32_t fd;
+	int i;
+
+	fd = int80_call(SYS_OPEN, (uint32_t)SYSBENCH_FILE, 0, 0);
+	if (fd < 0)
+		return 0;
+	start = rdtsc();
+	if (batched) {
+		for (i = 0; i < SYSBENCH_READS; i++) {
+			io_sqe_t* sqe = &ring.sq[ring.sq_tail % IO_RING_ENTRIES];
+			sqe->op = IO_OP_READ;
+			sqe->fd = fd;
+			sqe->buf = (uint32_t)&read_buf[i];
+			sqe->nbytes = 1;
+			sqe->user_data = i;
+			ring.sq_tail++;
+		}
+		int80_call(SYS_IO_RING_ENTER, (uint32_t)&ring, 0, 0);
+		ring.cq_head = ring.cq_tail;
+	} else {
+		for (i = 0; i < SYSBENCH_READS; i++)
+			int80_call(SYS_READ, fd, (uint32_t)&read_buf[i], 1);
+	}
+	cycles = rdtsc() - start;
+	int80_call(SYS_CLOSE, fd, 0, 0);
+	return (uint32_t)cycles;
+}
+
+void
+_start(void)
+{
+	time_calls("int 0x80", int80_call);
+	if (has_sysenter())
+		time_calls("sysenter", sysenter_call);
+	else
+		print("sysenter: not supported by this processor\n");
+	/* Both once untimed first, to fault in the ring, the buffer and the file's pages */
+	time_reads(0);
+	time_reads(1);
+	print("read: ");
+	print_uint(time_reads(0));
+	print(" cycles, io_ring_enter: ");
+	print_uint(time_reads(1));
+	print(" cycles for ");
+	print_uint(SYSBENCH_READS);
+	print(" one byte reads\n");
+	int80_call(SYS_HALT, 0, 0, 0);
+}
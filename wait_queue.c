@@ -0,0 +1,60 @@
+/*
+*   wait_queue.c - sleep/wakeup for tasks waiting on an event (a line of keyboard input, an RTC
+*   interrupt). A blocked task is off the run queue, so it takes no time slices until the
+*   interrupt handler for its event wakes it up.
+*/
+
+#include "wait_queue.h"
+#include "scheduling.h"
+#include "system_calls.h"
+#include "lib.h"
+
+/*
+*   Function: sleep_on
+*   Description: blocks the current task on a queue and runs another task (or the idle task) until
+*                wake_up_all is called on the queue. Callers check their condition again after it returns
+*   inputs: queue -- the queue to wait on
+*   outputs: none
+*   effects: must be called with interrupts off, they are off again when it returns
+*/
+void
+sleep_on(wait_queue_t * queue)
+{
+	pcb_t * task = current_task;
+	pcb_t * next;
+
+	task->state = TASK_BLOCKED;
+	task->run_next = NULL;
+	if (queue->tail != NULL)
+		queue->tail->run_next = task;
+	else
+		queue->head = task;
+	queue->tail = task;
+
+	/* With nothing else ready the idle task runs until the wakeup */
+	next = pick_next_task();
+	doContextSwitch(next != NULL ? next : idle_task);
+}
+
+/*
+*   Function: wake_up_all
+*   Description: moves every task waiting on a queue to the top level of the run queue: it gave up the
+*                CPU waiting for input, so it gets to respond quickly
+*   inputs: queue -- the queue to empty
+*   outputs: none
+*   effects: must be called with interrupts off
+*/
+void
+wake_up_all(wait_queue_t * queue)
+{
+	pcb_t * task = queue->head;
+	pcb_t * next;
+
+	queue->head = NULL;
+	queue->tail = NULL;
+	for (; task != NULL; task = next) {
+		next = task->run_next;
+		boost_task(task);
+		task_ready(task);
+	}
+}
@@ -0,0 +1,27 @@
+/*
+*	wait_queue.h - Function Header File to be used with "wait_queue.c"
+*/
+#ifndef _WAIT_QUEUE_H
+#define _WAIT_QUEUE_H
+
+#include "types.h"
+
+struct pcb;
+
+/*** Struct: wait_queue_t - tasks blocked until an event, linked through their run_next
+*    head, tail - first and last waiting task
+***/
+typedef struct wait_queue {
+	struct pcb * head;
+	struct pcb * tail;
+} wait_queue_t;
+
+#define WAIT_QUEUE_INIT		{ NULL, NULL }
+
+/* Blocks the current task on a queue until it is woken, interrupts must be off */
+void sleep_on(wait_queue_t * queue);
+
+/* Makes every task waiting on a queue runnable again */
+void wake_up_all(wait_queue_t * queue);
+
+#endif /* _WAIT_QUEUE_H */
@@ -15,6 +15,11 @@
 #define USER_DS 0x002B
 #define KERNEL_TSS 0x0030
 #define KERNEL_LDT 0x0038
+/* TSS selectors of the application processors follow the LDT, one per processor */
+#define AP_TSS_BASE 0x0040
+
+/* Processors the kernel can run on */
+#define MAX_CPUS 8
 
 /* Size of the task state segment (TSS) */
 #define TSS_SIZE 104
@@ -123,6 +128,7 @@ extern uint32_t ldt;
 extern uint32_t tss_size;
 extern seg_desc_t tss_desc_ptr;
 extern tss_t tss;
+extern seg_desc_t ap_tss_desc_ptr[MAX_CPUS - 1];
 
 /* Sets runtime-settable parameters in the GDT entry for the LDT */
 #define SET_LDT_PARAMS(str, addr, lim) \